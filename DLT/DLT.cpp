@@ -1,10 +1,11 @@
 #include "DLT.h"
+#include "TrainingSet.h"
+#include "WorkPool.h"
+#include <algorithm>
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
-#include <future>
-#include <tuple>
-#include <string.h>
+#include <random>
 
 using namespace std;
 
@@ -14,308 +15,301 @@ using namespace std;
  * Helper functions                    *
  ***************************************/
 
-double CalcEntropy(Sample* data, int count)
+// Moves the indices of the samples that go low on the split to the front of
+// samples, in place, and returns how many there are
+int partitionOn(const unsigned char* column, int* samples, int count, int value)
 {
-	vector<int> counts;
-	for(int i=0;i<count;++i)
-	{
-		Sample s = data[i];
-		if(s.type >= counts.size())
-		{
-			counts.resize(s.type + 1);
-		}
-		++counts[s.type];
-	}
-	double entropy = 0;
-	for(int i = 0; i < counts.size(); i++) {
-		double prob = counts[i] / (double)count;
-		if(prob > 0)
-			entropy -= prob * log(prob)/log(2);
-	}
-	return entropy;
+	return partition(samples, samples + count,
+		[=](int s) { return column[s] <= value; }) - samples;
 }
 
-double CalcEntropy(const Sample* data, int count, int splitId, int splitVal)
+/***************************************
+ * Histogram training                  *
+ ***************************************/
+
+// Samples each task counts when building a node's histograms, and the
+// smallest node worth building on several threads
+const int HISTOGRAM_CHUNK = 1 << 16;
+
+// Number of samples of each class at each value of each attribute, laid
+// out as counts[(attr * values + value) * classes + type]
+class Histogram
 {
-	vector<int> lowCount, highCount;
-	int lowSize=0, highSize=0;
-	for(int i=0;i<count;++i)
+public:
+	Histogram(int attr, int values, int classes):
+	attr(attr)
+	,values(values)
+	,classes(classes)
+	,counts(attr * values * classes)
 	{
-		Sample s = data[i];
-		if(s.iAttr[splitId]>splitVal)
-		{
-			if(s.type >= highCount.size())
-			{
-				highCount.resize(s.type + 1);
-			}
-			++highCount[s.type];
-			++highSize;
-		}
-		else
+	}
+
+	void Add(const TrainingSet& set, const int* samples, int count)
+	{
+		const unsigned char* tags = set.Tags();
+		for(int a = 0; a < attr; ++a)
 		{
-			if(s.type >= lowCount.size())
+			const unsigned char* column = set.Column(a);
+			int* attrCounts = &counts[a * values * classes];
+			for(int i = 0; i < count; ++i)
 			{
-				lowCount.resize(s.type + 1);
+				int s = samples[i];
+				++attrCounts[column[s] * classes + tags[s]];
 			}
-			++lowCount[s.type];
-			++lowSize;
 		}
 	}
-	double highEntropy = 0, lowEntropy=0;
-	for(int i = 0; i < highCount.size(); i++)
+
+	void Merge(const Histogram& other)
 	{
-		double prob = highCount[i] / (double)count;
-		if(prob > 0)
+		for(unsigned int i = 0; i < counts.size(); ++i)
 		{
-			highEntropy -= prob * log(prob)/log(2);
+			counts[i] += other.counts[i];
 		}
 	}
-	for(int i=0;i<lowCount.size();++i)
+
+	int attr;
+	int values;
+	int classes;
+	vector<int> counts;
+};
+
+// n log n, less the same for each class, summed over both sides of a split
+// is the split's entropy times the sample count times ln 2, which is all
+// that's needed to compare splits of the same node
+double SideEntropy(const int* classCounts, int classes)
+{
+	int size = 0;
+	double entropy = 0;
+	for(int c = 0; c < classes; ++c)
 	{
-		double prob=lowCount[i]/(double)count;
-		if(prob>0)
+		if(classCounts[c] > 0)
 		{
-			lowEntropy-=prob*log(prob)/log(2);
+			size += classCounts[c];
+			entropy -= classCounts[c] * log((double)classCounts[c]);
 		}
 	}
-	return highEntropy*highSize/(double)count + lowEntropy*lowSize/(double)count;
+	return size > 0 ? entropy + size * log((double)size) : 0;
 }
 
-Sample* splitOn(const Sample* data, int count, int id, int value, int &retSize, bool greater)
+Histogram BuildHistogram(WorkPool& pool, const TrainingSet& set, const int* samples, int count,
+	int attr, int values, int classes)
 {
-	Sample* temp, *ret=new Sample[count];
-	retSize=0;
-	for(int i=0;i<count;++i)
+	Histogram histogram(attr, values, classes);
+	if(count < 2 * HISTOGRAM_CHUNK)
 	{
-		Sample s = data[i];
-		if(s.iAttr[id] <= value ^ greater) //xor
-		{
-			ret[retSize]=s;
-			++retSize;
-		}
+		histogram.Add(set, samples, count);
+		return histogram;
+	}
+	int chunks = (count + HISTOGRAM_CHUNK - 1) / HISTOGRAM_CHUNK;
+	vector<Histogram> partials(chunks, Histogram(attr, values, classes));
+	vector<WorkPool::Task> tasks;
+	for(int i = 0; i < chunks; ++i)
+	{
+		tasks.push_back([&, i]()
+			{
+				int start = i * HISTOGRAM_CHUNK;
+				partials[i].Add(set, samples + start, min(HISTOGRAM_CHUNK, count - start));
+			});
+	}
+	pool.Run(tasks);
+	for(int i = 0; i < chunks; ++i)
+	{
+		histogram.Merge(partials[i]);
 	}
-	temp=new Sample[retSize];
-	memcpy(temp, ret, sizeof(Sample)*retSize);
-	delete ret;
-	return temp;
+	return histogram;
 }
 
-/*
-This getBestSplit does not use async, it is serial
-*/
+// What every node of one training run shares
+struct Training
+{
+	WorkPool& pool;
+	const TrainingSet& set;
+	int attr;
+	// Histogram sizes, one more than the largest value and class in the set
+	int values;
+	int classes;
+	// How many attributes each split chooses from, at random when fewer
+	// than attr
+	int features;
+};
+
+// Scrambles a node's seed into its children's, so every node of every tree
+// draws different attributes however the work is scheduled
+unsigned int Mix(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+// A bit for each attribute a node may split on
+unsigned int ChooseAttributes(int attr, int features, unsigned int seed)
+{
+	if(features >= attr)
+	{
+		return (1u << attr) - 1;
+	}
+	minstd_rand random(seed | 1);
+	vector<int> order(attr);
+	for(int a = 0; a < attr; ++a)
+	{
+		order[a] = a;
+	}
+	unsigned int chosen = 0;
+	for(int i = 0; i < features; ++i)
+	{
+		swap(order[i], order[i + random() % (attr - i)]);
+		chosen |= 1u << order[i];
+	}
+	return chosen;
+}
 
-/*
-void getBestSplit(const Sample* data, int attr, int count, int& id, int& value)
+// Sweeps every threshold below each attribute's largest value in the node,
+// keeping running counts of the low side, and picks the one that leaves the
+// least entropy, the first attribute and lowest threshold on ties. Only
+// the attributes in chosen are tried.
+void getBestSplit(const Histogram& histogram, unsigned int chosen, int& id, int& value)
 {
-	double lowestEntropyMeasure = 1000000.0;
+	int attr = histogram.attr, values = histogram.values, classes = histogram.classes;
+	vector<int> total(classes), low(classes), high(classes);
+	for(int v = 0; v < values; ++v)
+	{
+		for(int c = 0; c < classes; ++c)
+		{
+			total[c] += histogram.counts[v * classes + c];
+		}
+	}
+	double lowestEntropyMeasure = 1e300;
 	id = 0;
 	value = 0;
-	//Test each split
-	for(int i = 0; i < attr; i++)
+	for(int a = 0; a < attr; ++a)
 	{
+		if(!(chosen & (1u << a)))
+		{
+			continue;
+		}
+		const int* counts = &histogram.counts[a * values * classes];
 		int biggestValue = 0;
-		for(int j=0;j<count;++j)
+		for(int v = values - 1; v > 0 && biggestValue == 0; --v)
 		{
-			if(biggestValue < data[j].iAttr[i])
+			for(int c = 0; c < classes; ++c)
 			{
-				biggestValue = data[j].iAttr[i];
+				if(counts[v * classes + c] > 0)
+				{
+					biggestValue = v;
+				}
 			}
 		}
+		fill(low.begin(), low.end(), 0);
 		for(int curValue = 0; curValue < biggestValue; ++curValue)
 		{
-			int highSideSize=0, lowSideSize=0;
-			Sample* highSide = splitOn(data, count, i, curValue, highSideSize, true);
-			Sample* lowSide = splitOn(data, count, i, curValue, lowSideSize, false);
-			double entropy = CalcEntropy(highSide, highSideSize)*highSideSize/(double)count +
-				             CalcEntropy(lowSide, lowSideSize)*lowSideSize/(double)count;
+			for(int c = 0; c < classes; ++c)
+			{
+				low[c] += counts[curValue * classes + c];
+				high[c] = total[c] - low[c];
+			}
+			double entropy = SideEntropy(&low[0], classes) + SideEntropy(&high[0], classes);
 			if(entropy < lowestEntropyMeasure)
 			{
 				lowestEntropyMeasure = entropy;
-				id = i;
+				id = a;
 				value = curValue;
 			}
-			delete highSide;
-			delete lowSide;
 		}
 	}
 }
-*/
-
 
-void getBestSplit(const Sample* data, int attr, int count, int& id, int& value)
+/***************************************
+ * Constructor                         *
+ ***************************************/
+// Histograms run up to the largest value and class in the whole set
+void MeasureSet(const TrainingSet& set, int attr, int& values, int& classes)
 {
-	double lowestEntropyMeasure = 1000000.0;
-	id = 0;
-	value = 0;
-	//Test each split
-	vector<future<tuple<float, int, int>>> futs;
-	for(int i = 0; i < attr; i++)
+	int count = set.Size();
+	values = 1;
+	classes = 1;
+	if(count == 0)
 	{
-		futs.push_back(async(launch::async,
-			[=]()->tuple<float, int, int>
-			{
-				vector<future<tuple<float, int, int>>> subFuts;
-				//printf("Starting task %d of %d\n", i+1, attr);
-				int biggestValue = 0;
-				for(int j=0;j<count;++j)
-				{
-					if(biggestValue < data[j].iAttr[i])
-					{
-						biggestValue = data[j].iAttr[i];
-					}
-				}
-				for(int j=0;j<3;++j)
-				{
-					subFuts.push_back(async(launch::async,
-						[=]()->tuple<float, int, int>
-						{
-							double lowestEnt=1000000;
-							tuple<float, int, int> ret;
-							for(int curValue = ((j*biggestValue)/3); curValue < (((j+1)*biggestValue)/3); ++curValue)
-							{
-								//printf("Starting test %d of %d (task %d of %d)\n", curValue+1, biggestValue, i+1, attr);
-								int highSideSize=0, lowSideSize=0;
-								double entropy = CalcEntropy(data, count, i, curValue);
-								if(entropy<lowestEnt)
-								{
-									lowestEnt=entropy;
-									ret=make_tuple(entropy, i, curValue);
-								}
-							}
-							return ret;
-						}));
-				}
-				double ent=1000000;
-				int index;
-				tuple<float, int, int> ret;
-				for(int i=0;i<subFuts.size();++i)
-				{
-					auto tup=subFuts[i].get();
-					if(get<0>(tup) < ent)
-					{
-						ent=get<0>(tup);
-						ret=make_tuple(get<0>(tup), get<1>(tup), get<2>(tup));
-					}
-				}
-				//printf("Done task %d of %d\n", i+1, attr);
-				return ret;
-			}));
+		return;
 	}
-	double ent=1000000;
-	int index;
-	for(int i=0;i<futs.size();++i)
+	for(int a = 0; a < attr; ++a)
 	{
-		auto tup=futs[i].get();
-		if(get<0>(tup) < ent)
-		{
-			ent=get<0>(tup);
-			id=get<1>(tup);
-			value=get<2>(tup);
-		}
+		const unsigned char* column = set.Column(a);
+		values = max(values, *max_element(column, column + count) + 1);
 	}
+	const unsigned char* tags = set.Tags();
+	classes = *max_element(tags, tags + count) + 1;
 }
 
-
-/*
-void getBestSplit(const Sample* data, int attr, int count, int& id, int& value)
+DLT::DLT(const TrainingSet& set, int attr, int depth)
 {
-	double lowestEntropyMeasure = 1000000.0;
-	id = 0;
-	value = 0;
-	//Test each split
-	vector<future<tuple<float, int, int>>> futs;
-	for(int i = 0; i < attr; i++)
+	WorkPool pool(0);
+	Training training = {pool, set, attr, 0, 0, attr};
+	MeasureSet(set, attr, training.values, training.classes);
+	vector<int> samples(set.Size());
+	for(int i = 0; i < set.Size(); ++i)
 	{
-		futs.push_back(async(launch::async,
-			[=]()->tuple<float, int, int>
-			{
-				printf("Starting task %d of %d\n", i+1, attr);
-				int biggestValue = 0;
-				for(int j=0;j<count;++j)
-				{
-					if(biggestValue < data[j].iAttr[i])
-					{
-						biggestValue = data[j].iAttr[i];
-					}
-				}
-				double lowestEnt=1000000;
-				tuple<float, int, int> ret;
-				for(int curValue = 0; curValue < biggestValue; ++curValue)
-				{
-					printf("Starting test %d of %d (task %d of %d)\n", curValue+1, biggestValue, i+1, attr);
-					int highSideSize=0, lowSideSize=0;
-					Sample* highSide = splitOn(data, count, i, curValue, highSideSize, true);
-					Sample* lowSide = splitOn(data, count, i, curValue, lowSideSize, false);
-					double entropy = CalcEntropy(highSide, highSideSize)*highSideSize/(double)count +
-										CalcEntropy(lowSide, lowSideSize)*lowSideSize/(double)count;
-					if(entropy<lowestEnt)
-					{
-						lowestEnt=entropy;
-						ret=make_tuple(entropy, i, curValue);
-					}
-					delete highSide;
-					delete lowSide;
-				}
-				return ret;
-			}));
+		samples[i] = i;
 	}
-	double ent=1000000;
-	int index;
-	for(int i=0;i<futs.size();++i)
+	Build(training, samples.data(), set.Size(), depth, 0);
+}
+
+DLT::DLT()
+{
+}
+
+void DLT::Build(const Training& training, int* samples, int count, int depth, unsigned int seed)
+{
+	int values = training.values, classes = training.classes;
+	Histogram histogram = BuildHistogram(training.pool, training.set, samples, count,
+		training.attr, values, classes);
+	vector<int> counts(classes);
+	for(int v = 0; v < values; ++v)
 	{
-		auto tup=futs[i].get();
-		if(get<0>(tup) < ent)
+		for(int c = 0; c < classes; ++c)
 		{
-			ent=get<0>(tup);
-			id=get<1>(tup);
-			value=get<2>(tup);
+			counts[c] += histogram.counts[v * classes + c];
 		}
 	}
-}
-*/
-
-/***************************************
- * Constructor                         *
- ***************************************/
-DLT::DLT(Sample* data, int count, int attr, int depth)
-{
-	double Entropy = CalcEntropy(data, count);
+	double Entropy = count > 0 ? SideEntropy(&counts[0], classes) / count / log(2) : 0;
 	if(depth <= 0 || Entropy < EPSILON)
 	{
 		printf("\nConstructing leaf node at height %d\n", depth);
-		vector<int> counts;
-		for(int i=0;i<count;++i)
-		{
-			Sample s = data[i];
-			if(s.type >= counts.size())
-			{
-				counts.resize(s.type + 1);
-			}
-			++counts[s.type];
-		}
 		splitId = -1;
 		lowSide = NULL;
 		highSide = NULL;
 		int max_count = 0;
-		for(int i = 0; i < counts.size(); ++i)
+		for(unsigned int i = 0; i < counts.size(); ++i)
 		{
 			if(counts[i] > counts[max_count])
 				max_count = i;
 		}
 		splitVal = max_count;
-		delete data;
 		return;
 	}
 	else
 	{
 		printf("\nConstructing node at height %d\n", depth);
-		int highSideSize, lowSideSize;
-		getBestSplit(data, attr, count, splitId, splitVal);
-		Sample *highData=splitOn(data, count, splitId, splitVal, highSideSize, true);
-		Sample *lowData=splitOn(data, count, splitId, splitVal, lowSideSize, false);
-		delete data;
-		highSide = new DLT(highData, highSideSize, attr, depth - 1);
-		lowSide = new DLT(lowData, lowSideSize, attr, depth - 1);
+		getBestSplit(histogram, ChooseAttributes(training.attr, training.features, seed), splitId, splitVal);
+		int lowSideSize = partitionOn(training.set.Column(splitId), samples, count, splitVal);
+		int *lowData = samples, *highData = samples + lowSideSize;
+		int highSideSize = count - lowSideSize;
+		highSide = new DLT();
+		lowSide = new DLT();
+		auto buildHigh = [=, &training]() { highSide->Build(training, highData, highSideSize, depth - 1, Mix(2 * seed + 1)); };
+		auto buildLow = [=, &training]() { lowSide->Build(training, lowData, lowSideSize, depth - 1, Mix(2 * seed + 2)); };
+		if(count >= HISTOGRAM_CHUNK)
+		{
+			training.pool.Run(vector<WorkPool::Task>{buildHigh, buildLow});
+		}
+		else
+		{
+			buildHigh();
+			buildLow();
+		}
 	}
 }
 
@@ -353,3 +347,59 @@ DLT::DLT(istream& fin) {
 		highSide = new DLT(fin);
 	}
 }
+
+/***************************************
+ * Forest                              *
+ ***************************************/
+Forest::Forest(const TrainingSet& set, int attr, int depth, int size, int features)
+{
+	WorkPool pool(0);
+	Training training = {pool, set, attr, 0, 0, features};
+	MeasureSet(set, attr, training.values, training.classes);
+	int count = set.Size();
+	trees.resize(size);
+	// Trees start a pool's worth at a time. Otherwise a thread waiting on
+	// one tree's subtrees would start other trees, each drawing a bag as
+	// long as the set.
+	int wave = pool.Threads();
+	for(int first = 0; first < size; first += wave)
+	{
+		vector<WorkPool::Task> tasks;
+		for(int t = first; t < min(size, first + wave); ++t)
+		{
+			tasks.push_back([&, t]()
+				{
+					mt19937 random(t + 1);
+					uniform_int_distribution<int> pick(0, count - 1);
+					vector<int> bag(count);
+					for(int i = 0; i < count; ++i)
+					{
+						bag[i] = pick(random);
+					}
+					// Only which samples a node holds matters, and in order they
+					// are read from the columns sequentially
+					sort(bag.begin(), bag.end());
+					trees[t] = new DLT();
+					trees[t]->Build(training, bag.data(), count, depth, random());
+				});
+		}
+		pool.Run(tasks);
+	}
+}
+
+int Forest::Classify(const Sample& s) {
+	vector<int> votes;
+	for(unsigned int t = 0; t < trees.size(); ++t) {
+		int label = trees[t]->Classify(s);
+		if(label >= (int) votes.size())
+			votes.resize(label + 1);
+		++votes[label];
+	}
+	return max_element(votes.begin(), votes.end()) - votes.begin();
+}
+
+void Forest::Save(ostream& fout) {
+	fout << "Forest " << trees.size() << endl;
+	for(unsigned int t = 0; t < trees.size(); ++t)
+		trees[t]->Save(fout);
+}
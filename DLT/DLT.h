@@ -1,3 +1,6 @@
+#ifndef _DLT_H
+#define _DLT_H
+
 #include <list>
 #include <vector>
 #include <string>
@@ -6,6 +9,9 @@
 const int ATTR=5;
 const int DEPTH=5;
 
+struct Training;
+class TrainingSet;
+
 class Sample
 {
 public:
@@ -15,13 +21,37 @@ public:
 
 class DLT {
 	public:
-		DLT(Sample* trainingSet, int count, int attr, int depth);
+		// Trains on every hardware thread. Each node counts its samples into
+		// a histogram per attribute once and then tries every threshold from
+		// running totals. The set's columns are read in place through a list
+		// of sample indices, which is what gets reordered as nodes split.
+		DLT(const TrainingSet& trainingSet, int attr, int depth);
 		DLT(std::istream& fin);
 		int Classify(const Sample& s);
 		void Save(std::ostream& fout);
 	private:
+		DLT();
+		void Build(const Training& training, int* samples, int count, int depth, unsigned int seed);
 		int splitId;
 		int splitVal;
 		DLT* lowSide;
 		DLT* highSide;
+		friend class Forest;
 };
+
+// Trees that each learn from a bootstrap resample of the training set, with
+// every split chosen from a random few of the attributes, and then vote on a
+// label, ties going to the lowest. Saved as "Forest n" and then each tree.
+class Forest {
+	public:
+		// Trains size trees on every hardware thread, as many at once as
+		// there are threads, choosing each split from features of the
+		// attributes. A tree's resample is a list of indices into the set.
+		Forest(const TrainingSet& trainingSet, int attr, int depth, int size, int features);
+		int Classify(const Sample& s);
+		void Save(std::ostream& fout);
+	private:
+		std::vector<DLT*> trees;
+};
+
+#endif
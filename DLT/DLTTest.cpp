@@ -1,12 +1,17 @@
 #include "DLT.h"
+#include "TrainingSet.h"
 #include "sqlite3.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <string.h>
 #include <iostream>
 #include <ctime>
 using namespace std;
 
+// Attributes each split of a forest's trees chooses from
+const int FOREST_FEATURES = 3;
+
 //int DepthTest() {
 //	list<Sample*> trainingSet;
 //	/*for(int i = 0; i < 1000000; i++) {
@@ -28,51 +33,42 @@ using namespace std;
 //	return 0;
 //}
 
-void test(DLT tree, sqlite3 *db, int count)
+void test(DLT tree, const TrainingSet& set)
 {
-	sqlite3_stmt *statement;
-	sqlite3_prepare_v2(db, "select avgSat, avgBright, imageData.hue, imageData.saturation, imageData.brightness, imageData.tag from frameData join imageData where frameData.id=imageData.frame;", -1, &statement, 0);
-	int cols = sqlite3_column_count(statement);
-	int result = 0, progress=0, good=0;
-	while(true)
+	int count = set.Size(), good = 0;
+	Sample sample;
+	for(int i = 0; i < count; ++i)
 	{
-		result = sqlite3_step(statement);
-		if(result == SQLITE_ROW)
+		set.Get(i, sample);
+		if(tree.Classify(sample)==sample.type)
 		{
-			if(progress%(count/100)==0)
-			{
-				printf("Testing tree: %d%%\n", (int)(100*(float)(progress+1)/(float)count));
-			}
-			Sample sample;
-			for(int col = 0; col < cols; col++)
-			{
-				if(col==ATTR)
-				{
-					sample.type=atoi((char*)sqlite3_column_text(statement, col));
-					continue;
-				}
-				sample.iAttr[col]=atoi((char*)sqlite3_column_text(statement, col));
-			}
-			if(tree.Classify(sample)==sample.type)
-			{
-				++good;
-			}
-			++progress;
+			++good;
 		}
-		else
+	}
+	printf("Results(%d): %f%%\n", DEPTH, (float)good*100/count);
+	system("pause");
+}
+
+void test(Forest forest, const TrainingSet& set)
+{
+	int count = set.Size(), good = 0;
+	Sample sample;
+	for(int i = 0; i < count; ++i)
+	{
+		set.Get(i, sample);
+		if(forest.Classify(sample)==sample.type)
 		{
-			break;   
+			++good;
 		}
 	}
-	sqlite3_finalize(statement);
 	printf("Results(%d): %f%%\n", DEPTH, (float)good*100/count);
 	system("pause");
 }
 
-DLT SavingTest(Sample* data, int count) 
+DLT SavingTest(const TrainingSet& set) 
 {
 	printf("Training original tree\n");
-	DLT original(data, count, ATTR , DEPTH);
+	DLT original(set, ATTR , DEPTH);
 	ofstream fout ("test.tree");
 	printf("Saving tree\n");
 	original.Save(fout);
@@ -80,59 +76,76 @@ DLT SavingTest(Sample* data, int count)
 	return original;
 }
 
+Forest ForestTest(const TrainingSet& set, int size)
+{
+	printf("Training forest of %d trees\n", size);
+	Forest forest(set, ATTR, DEPTH, size, FOREST_FEATURES);
+	ofstream fout ("test.tree");
+	printf("Saving forest\n");
+	forest.Save(fout);
+	fout.close();
+	return forest;
+}
+
+// DLTGen [-f trees] samples [export]
+//
+// samples is either a tagging database or a training set exported from one,
+// which is mapped instead of queried. Given export, the samples are written
+// there as a training set first. With -f, a forest of that many trees is
+// trained instead of a single tree.
 int main(int argc, char* argv[]) 
 {
-	sqlite3 *db;
-	sqlite3_stmt *statement;
-	int count;
-	Sample* data;
-	if(sqlite3_open(argv[1], &db))
+	int forestSize = 0, arg = 1;
+	if(argc > 2 && strcmp(argv[1], "-f") == 0)
 	{
-		puts("Cannot open database\n");
+		forestSize = atoi(argv[2]);
+		arg = 3;
+	}
+	if(argc <= arg)
+	{
+		printf("usage: %s [-f trees] samples [export]\n", argv[0]);
 		return 0;
 	}
-	if(sqlite3_prepare_v2(db, "select COUNT(*) from imageData;", -1, &statement, 0)==SQLITE_OK)
+	TrainingSet set;
+	if(!set.Map(argv[arg]))
 	{
-		sqlite3_step(statement);
-		count=atoi((char*)sqlite3_column_text(statement, 0));
-		data=new Sample[count];
-		sqlite3_prepare_v2(db, "select avgSat, avgBright, imageData.hue, imageData.saturation, imageData.brightness, imageData.tag from frameData join imageData where frameData.id=imageData.frame;", -1, &statement, 0);
-		int cols = sqlite3_column_count(statement);
-		int result = 0, progress=0;
-		while(true)
+		sqlite3 *db;
+		if(sqlite3_open_v2(argv[arg], &db, SQLITE_OPEN_READONLY, 0) != SQLITE_OK)
+		{
+			puts("Cannot open database\n");
+			return 0;
+		}
+		puts("Reading Database");
+		bool loaded = set.Load(db);
+		sqlite3_close(db);
+		if(!loaded)
 		{
-			result = sqlite3_step(statement);
-			if(result == SQLITE_ROW)
-			{
-				if(progress%(count/100)==0)
-				{
-					printf("Reading Database: %d%%\n", (int)(100*(float)(progress+1)/(float)count));
-				}
-				Sample sample;
-				for(int col = 0; col < cols; col++)
-				{
-					if(col==ATTR)
-					{
-						sample.type=atoi((char*)sqlite3_column_text(statement, col));
-						continue;
-					}
-					sample.iAttr[col]=atoi((char*)sqlite3_column_text(statement, col));
-				}
-				data[progress]=sample;
-				++progress;
-			}
-			else
-			{
-				break;   
-			}
+			puts("Cannot read samples from database\n");
+			return 0;
 		}
-		sqlite3_finalize(statement);
+	}
+	if(set.Size() == 0)
+	{
+		printf("No samples in %s\n", argv[arg]);
+		return 0;
+	}
+	if(argc > arg + 1 && !set.Write(argv[arg + 1]))
+	{
+		printf("Cannot write %s\n", argv[arg + 1]);
+		return 0;
 	}
 
 	puts("Database read, starting tree generation");
 	/*auto begin=time(0);
-	auto tree=SavingTest(data, count);
+	auto tree=SavingTest(set);
 	cout<<time(0)-begin<<endl;
-	test(tree, db, count);*/
-	test(SavingTest(data, count), db, count);
+	test(tree, set);*/
+	if(forestSize > 1)
+	{
+		test(ForestTest(set, forestSize), set);
+	}
+	else
+	{
+		test(SavingTest(set), set);
+	}
 }
@@ -0,0 +1,144 @@
+#include "TrainingSet.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = {'D', 'L', 'T', 'S', 'A', 'M', 'P', '1'};
+// Sets are written in native byte order, so one from a machine of the other
+// order is refused by Map. The vision node's ClassifierBundle maps its files
+// the same way but builds as its own ROS package, so it keeps its own copy.
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const char* QUERY = "select avgSat, avgBright, imageData.hue, imageData.saturation, imageData.brightness, imageData.tag from frameData join imageData where frameData.id=imageData.frame;";
+
+struct Header {
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t attributes;
+	uint32_t count;
+};
+
+}
+
+TrainingSet::TrainingSet():
+count(0)
+,data(NULL)
+,size(0)
+{
+	for(int i = 0; i <= ATTR; ++i)
+		columns[i] = NULL;
+}
+
+TrainingSet::~TrainingSet() {
+	Unmap();
+}
+
+bool TrainingSet::Load(sqlite3* db) {
+	Unmap();
+	for(int i = 0; i <= ATTR; ++i)
+		loaded[i].clear();
+	sqlite3_stmt* statement;
+	if(sqlite3_prepare_v2(db, QUERY, -1, &statement, 0) != SQLITE_OK)
+		return false;
+	bool fits = true;
+	int result;
+	while(fits && (result = sqlite3_step(statement)) == SQLITE_ROW) {
+		for(int col = 0; col <= ATTR; ++col) {
+			int value = sqlite3_column_int(statement, col);
+			fits = fits && value >= 0 && value <= 255;
+			loaded[col].push_back(value);
+		}
+	}
+	sqlite3_finalize(statement);
+	if(!fits || result != SQLITE_DONE) {
+		for(int i = 0; i <= ATTR; ++i)
+			loaded[i].clear();
+		return false;
+	}
+	count = loaded[0].size();
+	for(int i = 0; i <= ATTR; ++i)
+		columns[i] = loaded[i].data();
+	return true;
+}
+
+bool TrainingSet::Map(const string& path) {
+	Unmap();
+	int file = open(path.c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+	struct stat info;
+	if(fstat(file, &info) == 0 && info.st_size >= (off_t) sizeof(Header)) {
+		void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if(mapped != MAP_FAILED) {
+			data = (const char*) mapped;
+			size = info.st_size;
+		}
+	}
+	close(file);
+	if(!data)
+		return false;
+	const Header* head = (const Header*) data;
+	if(memcmp(head->magic, MAGIC, sizeof(MAGIC)) != 0 || head->byteOrder != BYTE_ORDER_MARK
+			|| head->attributes != ATTR
+			|| head->count > (size - sizeof(Header)) / (ATTR + 1)) {
+		Unmap();
+		return false;
+	}
+	// Sequential reads are all training and testing ever do
+	madvise((void*) data, size, MADV_SEQUENTIAL);
+	count = head->count;
+	for(int i = 0; i <= ATTR; ++i)
+		columns[i] = (const unsigned char*) data + sizeof(Header) + (size_t) i * count;
+	return true;
+}
+
+void TrainingSet::Unmap() {
+	if(data)
+		munmap((void*) data, size);
+	data = NULL;
+	size = 0;
+	count = 0;
+	for(int i = 0; i <= ATTR; ++i)
+		columns[i] = NULL;
+}
+
+bool TrainingSet::Write(const string& path) const {
+	Header head;
+	memcpy(head.magic, MAGIC, sizeof(MAGIC));
+	head.byteOrder = BYTE_ORDER_MARK;
+	head.attributes = ATTR;
+	head.count = count;
+	string temporary = path + ".tmp";
+	ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+	out.write((const char*) &head, sizeof(head));
+	for(int i = 0; i <= ATTR; ++i)
+		out.write((const char*) columns[i], count);
+	out.close();
+	return !out.fail() && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+int TrainingSet::Size() const {
+	return count;
+}
+
+const unsigned char* TrainingSet::Column(int attr) const {
+	return columns[attr];
+}
+
+const unsigned char* TrainingSet::Tags() const {
+	return columns[ATTR];
+}
+
+void TrainingSet::Get(int index, Sample& s) const {
+	for(int i = 0; i < ATTR; ++i)
+		s.iAttr[i] = columns[i][index];
+	s.type = columns[ATTR][index];
+}
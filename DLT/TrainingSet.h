@@ -0,0 +1,40 @@
+#ifndef _TRAINING_SET_H
+#define _TRAINING_SET_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "DLT.h"
+#include "sqlite3.h"
+
+// Tagged pixels to train and test on, held as one column of bytes for each
+// attribute and one for the tags, so a pass over the set only reads what it
+// uses. A set is either read from a tagging database or mapped from a file
+// Write made of it: a header, then each column in turn.
+class TrainingSet {
+	public:
+		TrainingSet();
+		~TrainingSet();
+		// False if the query fails or a value doesn't fit in a byte
+		bool Load(sqlite3* db);
+		// False if the file can't be mapped or isn't a whole set
+		bool Map(const std::string& path);
+		bool Write(const std::string& path) const;
+		int Size() const;
+		const unsigned char* Column(int attr) const;
+		const unsigned char* Tags() const;
+		void Get(int index, Sample& s) const;
+	private:
+		TrainingSet(const TrainingSet&);
+		TrainingSet& operator=(const TrainingSet&);
+		void Unmap();
+		int count;
+		// The attribute columns then the tags, pointing into loaded or the mapping
+		const unsigned char* columns[ATTR + 1];
+		std::vector<unsigned char> loaded[ATTR + 1];
+		const char* data;
+		size_t size;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "WorkPool.h"
+
+using namespace std;
+
+// The pool and queue the current thread works for, if it is a worker
+static thread_local const WorkPool* workerPool = NULL;
+static thread_local unsigned int workerIndex = 0;
+
+WorkPool::WorkPool(unsigned int threads):
+queued(0)
+,stopping(false)
+{
+	if(threads == 0) {
+		threads = max(1u, thread::hardware_concurrency());
+	}
+	for(unsigned int i = 0; i <= threads; ++i) {
+		queues.push_back(unique_ptr<Queue>(new Queue()));
+	}
+	for(unsigned int i = 0; i < threads; ++i) {
+		this->threads.push_back(thread(&WorkPool::Work, this, i));
+	}
+}
+
+WorkPool::~WorkPool() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(unsigned int i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+}
+
+unsigned int WorkPool::Threads() const {
+	return threads.size();
+}
+
+void WorkPool::Run(const vector<Task>& tasks) {
+	if(tasks.empty()) {
+		return;
+	}
+	Batch batch;
+	batch.remaining = tasks.size();
+	unsigned int index = Index();
+	{
+		Queue& queue = *queues[index];
+		lock_guard<std::mutex> lock(queue.mutex);
+		for(unsigned int i = 0; i < tasks.size(); ++i) {
+			Job job;
+			job.task = tasks[i];
+			job.batch = &batch;
+			queue.jobs.push_back(job);
+		}
+	}
+	{
+		lock_guard<std::mutex> lock(mutex);
+		queued += tasks.size();
+	}
+	wake.notify_all();
+	while(batch.remaining > 0) {
+		if(!RunOne(index)) {
+			unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return batch.remaining == 0 || queued > 0; });
+		}
+	}
+}
+
+void WorkPool::Work(unsigned int index) {
+	workerPool = this;
+	workerIndex = index;
+	while(true) {
+		if(RunOne(index)) {
+			continue;
+		}
+		unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [&]() { return stopping || queued > 0; });
+		if(stopping && queued == 0) {
+			return;
+		}
+	}
+}
+
+unsigned int WorkPool::Index() const {
+	return workerPool == this ? workerIndex : queues.size() - 1;
+}
+
+// Runs the newest task from this thread's own queue, or else the oldest from
+// another's; false if every queue was empty
+bool WorkPool::RunOne(unsigned int index) {
+	Job job;
+	bool found = false;
+	for(unsigned int i = 0; i < queues.size() && !found; ++i) {
+		Queue& queue = *queues[(index + i) % queues.size()];
+		lock_guard<std::mutex> lock(queue.mutex);
+		if(!queue.jobs.empty()) {
+			if(i == 0) {
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			} else {
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+			}
+			found = true;
+		}
+	}
+	if(!found) {
+		return false;
+	}
+	--queued;
+	job.task();
+	Finish(job.batch);
+	return true;
+}
+
+void WorkPool::Finish(Batch* batch) {
+	if(--batch->remaining == 0) {
+		// Taking the lock makes sure whoever is waiting on the batch is
+		// either asleep to be woken or yet to check it
+		lock_guard<std::mutex> lock(mutex);
+		wake.notify_all();
+	}
+}
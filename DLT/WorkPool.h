@@ -0,0 +1,55 @@
+#ifndef _WORK_POOL_H
+#define _WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own queue of tasks. Run hands
+// over a batch of independent tasks and returns once all of them have
+// finished, working through tasks itself while it waits, so tasks can Run
+// batches of their own. A thread takes the newest task from its own queue
+// and, when that is empty, steals the oldest from another's, so the biggest
+// pieces of work spread out while each thread stays on its own.
+class WorkPool {
+	public:
+		typedef std::function<void()> Task;
+
+		// threads of 0 means one per hardware thread
+		WorkPool(unsigned int threads);
+		~WorkPool();
+		void Run(const std::vector<Task>& tasks);
+		unsigned int Threads() const;
+	private:
+		struct Batch {
+			std::atomic<unsigned int> remaining;
+		};
+		struct Job {
+			Task task;
+			Batch* batch;
+		};
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void Work(unsigned int index);
+		unsigned int Index() const;
+		bool RunOne(unsigned int index);
+		void Finish(Batch* batch);
+
+		// One queue per worker, then one shared by every other thread
+		std::vector<std::unique_ptr<Queue> > queues;
+		std::atomic<int> queued;
+		std::mutex mutex;
+		std::condition_variable wake;
+		bool stopping;
+		std::vector<std::thread> threads;
+};
+
+#endif
@@ -83,7 +83,9 @@ class BuoyTask():
     def image_recognition_cb(self, buoy):
         if not self.enabled:
             return
-        if len(self.buoys) and buoy.id == 0:
+        # Align on the last message each time another arrives, as happened
+        # while every id was 0
+        if len(self.buoys):
             self.align_to_buoy(self.select_correct_buoy())
             self.buoys = []
         self.buoys.append(buoy)
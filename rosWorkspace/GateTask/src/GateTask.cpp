@@ -7,6 +7,8 @@
 #include <math.h>
 #include <float.h>
 
+const float METERS_PER_INCH = 0.0254f;
+
 GateTask::GateTask()
  : m_nodeHandle(),
    m_gateSubscriber(),
@@ -62,13 +64,18 @@ void GateTask::moduleEnableCallback(const Robosub::ModuleEnableMsg& msg)
 
 void GateTask::gateCallback(const SubImageRecognition::ImgRecObject& msg)
 {
-    //               vvvvvv  This only works on gate Id 0
-  if (m_isEnabled && msg.id == 0) //It this ID the left gate?
+    // Act on every gate leg seen, as when every id was 0; ids now follow tracks
+  if (m_isEnabled)
   {
 
 
     float pixPerInch = getPixelsPerInch(msg.width, 3.0f);
     float dist = getDistance(msg.width, 3.0f);
+    // Prefer the stereo range when image recognition could measure one
+    if (msg.range > 0.0f)
+    {
+      dist = msg.range / METERS_PER_INCH;
+    }
     float x = (msg.center_x / pixPerInch) + 36.0f; //add a 3 feet
     float leftMost = msg.center_x - (msg.width/2.0f);
     float rightMost = msg.center_x + (msg.width/2.0f);
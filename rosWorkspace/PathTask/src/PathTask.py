@@ -84,7 +84,9 @@ class PathTask:
     def image_recognition_cb(self, path):
         if not self.enabled:
             return
-        if len(self.paths) and path.id == 0:
+        # Align on the last message each time another arrives, as happened
+        # while every id was 0
+        if len(self.paths):
             self.align_to_path(self.select_correct_path())
             self.paths = []
         self.paths.append(path)
@@ -0,0 +1,192 @@
+#define _USE_MATH_DEFINES
+
+#include "BlobLabeler.h"
+#include <algorithm>
+#include <functional>
+#include <math.h>
+
+using namespace cv;
+using namespace std;
+
+Blob::Blob():
+size(0)
+,minX(0)
+,minY(0)
+,maxX(0)
+,maxY(0)
+,sumX(0)
+,sumY(0)
+,sumXX(0)
+,sumXY(0)
+,sumYY(0)
+{
+}
+
+Blob::Blob(int x, int y):
+size(1)
+,minX(x)
+,minY(y)
+,maxX(x)
+,maxY(y)
+,sumX(x)
+,sumY(y)
+,sumXX((double) x * x)
+,sumXY((double) x * y)
+,sumYY((double) y * y)
+{
+}
+
+void Blob::add(int x, int y) {
+	++size;
+	minX = min(minX, x);
+	minY = min(minY, y);
+	maxX = max(maxX, x);
+	maxY = max(maxY, y);
+	sumX += x;
+	sumY += y;
+	sumXX += (double) x * x;
+	sumXY += (double) x * y;
+	sumYY += (double) y * y;
+}
+
+void Blob::merge(const Blob& other) {
+	size += other.size;
+	minX = min(minX, other.minX);
+	minY = min(minY, other.minY);
+	maxX = max(maxX, other.maxX);
+	maxY = max(maxY, other.maxY);
+	sumX += other.sumX;
+	sumY += other.sumY;
+	sumXX += other.sumXX;
+	sumXY += other.sumXY;
+	sumYY += other.sumYY;
+}
+
+RotatedRect Blob::fitRectangle(int step) const {
+	// A solid rectangle of side L has a variance of L^2/12 along it
+	return fit(12, step);
+}
+
+RotatedRect Blob::fitEllipse(int step) const {
+	// A solid ellipse with axis L has a variance of L^2/16 along it
+	return fit(16, step);
+}
+
+// Sampling every step pixels takes step^2/12 off the variance along each
+// axis, so that is added back
+void Blob::principalAxes(int step, double& x, double& y, double& major,
+		double& minor, double& angle) const {
+	x = sumX / size;
+	y = sumY / size;
+	double xx = sumXX / size - x * x;
+	double xy = sumXY / size - x * y;
+	double yy = sumYY / size - y * y;
+	double mean = (xx + yy) / 2;
+	double spread = sqrt((xx - yy) * (xx - yy) / 4 + xy * xy);
+	double sampling = step * step / 12.0;
+	major = mean + spread + sampling;
+	minor = max(0.0, mean - spread) + sampling;
+	angle = atan2(2 * xy, xx - yy) / 2;
+}
+
+// Sides along the principal axes of the blob's covariance, where each side's
+// variance is its length squared over scale
+RotatedRect Blob::fit(double scale, int step) const {
+	double x, y, major, minor, angle;
+	principalAxes(step, x, y, major, minor, angle);
+	return RotatedRect(Point2f(x, y), Size2f(sqrt(scale * major), sqrt(scale * minor)),
+			angle * 180 / M_PI);
+}
+
+int BlobLabeler::find(int label) {
+	while (parents[label] != label) {
+		parents[label] = parents[parents[label]];
+		label = parents[label];
+	}
+	return label;
+}
+
+int BlobLabeler::join(int a, int b) {
+	a = find(a);
+	b = find(b);
+	if (a == b) {
+		return a;
+	}
+	if (b < a) {
+		swap(a, b);
+	}
+	parents[b] = a;
+	stats[a].merge(stats[b]);
+	return a;
+}
+
+// First pixel of the sampling grid at or after start
+static int firstSample(int start, int offset, int step) {
+	return start <= offset ? offset : offset + (start - offset + step - 1) / step * step;
+}
+
+void BlobLabeler::reset() {
+	blobs.clear();
+}
+
+const vector<Blob>& BlobLabeler::label(const Mat& image, int offset, int step,
+		uint8_t value, const Rect& area) {
+	int top = firstSample(area.y, offset, step);
+	int left = firstSample(area.x, offset, step);
+	int bottom = min(image.rows, area.y + area.height);
+	int right = min(image.cols, area.x + area.width);
+	int cols = max(0, (right - left + step - 1) / step);
+	above.assign(cols, -1);
+	current.resize(cols);
+	parents.clear();
+	stats.clear();
+	for (int i = top; i < bottom; i += step) {
+		const uint8_t* row = image.ptr<uint8_t>(i);
+		for (int j = left, c = 0; j < right; j += step, c++) {
+			if (row[j] != value) {
+				current[c] = -1;
+				continue;
+			}
+			int before = c > 0 ? current[c - 1] : -1;
+			int up = above[c];
+			int label;
+			if (before < 0 && up < 0) {
+				label = parents.size();
+				parents.push_back(label);
+				stats.push_back(Blob(j, i));
+			} else {
+				if (before >= 0 && up >= 0) {
+					label = join(before, up);
+				} else {
+					label = find(before >= 0 ? before : up);
+				}
+				stats[label].add(j, i);
+			}
+			current[c] = label;
+		}
+		above.swap(current);
+	}
+	for (unsigned int label = 0; label < parents.size(); label++) {
+		if (parents[label] == (int) label) {
+			blobs.push_back(stats[label]);
+		}
+	}
+	return blobs;
+}
+
+void BlobLabeler::largest(unsigned int minSize, unsigned int count, vector<Blob>& winners) {
+	candidates.clear();
+	for (unsigned int i = 0; i < blobs.size(); i++) {
+		if (blobs[i].size >= minSize) {
+			candidates.push_back(make_pair(blobs[i].size, -(int) i));
+		}
+	}
+	// Ties go to the blob found first
+	count = min(count, (unsigned int) candidates.size());
+	partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+			greater<pair<unsigned int, int> >());
+	winners.clear();
+	for (unsigned int i = 0; i < count; i++) {
+		winners.push_back(blobs[-candidates[i].second]);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef _BLOB_LABELER_H
+#define _BLOB_LABELER_H
+
+#include <vector>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+// Area, bounding box and raw moments of one connected blob of sampled pixels,
+// in full image coordinates
+class Blob {
+public:
+	unsigned int size;
+	int minX, minY, maxX, maxY;
+	double sumX, sumY, sumXX, sumXY, sumYY;
+
+	Blob();
+	Blob(int x, int y);
+	void add(int x, int y);
+	void merge(const Blob& other);
+	// Rectangle, or the bounding box of the ellipse, with the same centroid
+	// and second moments as the blob, where step is the spacing between
+	// sampled pixels
+	cv::RotatedRect fitRectangle(int step) const;
+	cv::RotatedRect fitEllipse(int step) const;
+	// Centroid, variances along the major and minor principal axes, and the
+	// major axis' angle in radians, with the sampling step accounted for
+	void principalAxes(int step, double& x, double& y, double& major,
+			double& minor, double& angle) const;
+
+private:
+	cv::RotatedRect fit(double scale, int step) const;
+};
+
+// Finds the 4-connected blobs of one value on the grid of every step'th
+// pixel that falls inside area. Blobs from each label call are added to
+// those found since the last reset, so several separate areas can be
+// searched together. Labels are joined with union-find in a single pass over the grid
+// while each blob's statistics are accumulated, so no point lists are ever
+// built. Buffers are kept between calls to avoid reallocating every frame.
+class BlobLabeler {
+public:
+	void reset();
+	const std::vector<Blob>& label(const cv::Mat& image, int offset, int step,
+			uint8_t value, const cv::Rect& area);
+	// Copy out the count largest blobs of at least minSize found since the
+	// last reset, largest first. The rest are only ever handled by size and
+	// index, so a cluttered frame doesn't copy every candidate.
+	void largest(unsigned int minSize, unsigned int count, std::vector<Blob>& winners);
+
+private:
+	int find(int label);
+	int join(int a, int b);
+
+	// Provisional label of each grid cell of the previous and current rows
+	std::vector<int> above, current;
+	std::vector<int> parents;
+	std::vector<Blob> stats;
+	std::vector<Blob> blobs;
+	std::vector<std::pair<unsigned int, int> > candidates;
+};
+
+#endif
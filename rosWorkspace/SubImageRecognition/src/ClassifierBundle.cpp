@@ -0,0 +1,168 @@
+#include "ClassifierBundle.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[8] = {'D', 'L', 'T', 'B', 'N', 'D', 'L', '1'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const int NAME_SIZE = 32;
+const int MAX_DEPTH = 20;
+
+struct Header {
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t count;
+};
+
+struct Entry {
+	char name[NAME_SIZE];
+	int32_t depth;
+	// From the start of the file to the splits, which the leaves follow
+	uint32_t offset;
+};
+
+size_t treeBytes(int depth) {
+	return (2 * ((1 << depth) - 1) + (1 << depth)) * sizeof(int32_t);
+}
+
+const Header* header(const char* data) {
+	return (const Header*) data;
+}
+
+const Entry* entries(const char* data) {
+	return (const Entry*) (data + sizeof(Header));
+}
+
+}
+
+ClassifierBundle::ClassifierBundle():
+data(NULL)
+,size(0)
+{
+}
+
+ClassifierBundle::~ClassifierBundle() {
+	Unmap();
+}
+
+bool ClassifierBundle::Map(const string& path) {
+	Unmap();
+	int file = open(path.c_str(), O_RDONLY);
+	if(file < 0)
+		return false;
+	struct stat info;
+	if(fstat(file, &info) == 0 && info.st_size >= (off_t) sizeof(Header)) {
+		void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if(mapped != MAP_FAILED) {
+			data = (const char*) mapped;
+			size = info.st_size;
+		}
+	}
+	close(file);
+	if(data && !Valid())
+		Unmap();
+	return data != NULL;
+}
+
+void ClassifierBundle::Unmap() {
+	if(data)
+		munmap((void*) data, size);
+	data = NULL;
+	size = 0;
+}
+
+// Everything a corrupt or truncated file could get wrong, checked once so
+// the accessors can trust it
+bool ClassifierBundle::Valid() const {
+	const Header* head = header(data);
+	if(memcmp(head->magic, MAGIC, sizeof(MAGIC)) != 0 || head->byteOrder != BYTE_ORDER_MARK)
+		return false;
+	if(head->count > (size - sizeof(Header)) / sizeof(Entry))
+		return false;
+	for(uint32_t i = 0; i < head->count; ++i) {
+		const Entry& entry = entries(data)[i];
+		if(memchr(entry.name, 0, NAME_SIZE) == NULL || entry.depth < 0 || entry.depth > MAX_DEPTH)
+			return false;
+		if(entry.offset % sizeof(int32_t) != 0 || entry.offset > size
+				|| treeBytes(entry.depth) > size - entry.offset)
+			return false;
+		const int32_t* splits = (const int32_t*) (data + entry.offset);
+		for(int n = 0; n < (1 << entry.depth) - 1; ++n) {
+			if(splits[2 * n] < 0 || splits[2 * n] >= ATTR)
+				return false;
+		}
+	}
+	return true;
+}
+
+int ClassifierBundle::Size() const {
+	return data ? header(data)->count : 0;
+}
+
+string ClassifierBundle::Name(int index) const {
+	return entries(data)[index].name;
+}
+
+int ClassifierBundle::Find(const string& name) const {
+	for(int i = 0; i < Size(); ++i) {
+		if(name == entries(data)[i].name)
+			return i;
+	}
+	return -1;
+}
+
+FlatDLT ClassifierBundle::Tree(int index) const {
+	const Entry& entry = entries(data)[index];
+	const int32_t* splits = (const int32_t*) (data + entry.offset);
+	return FlatDLT(entry.depth, splits, splits + 2 * ((1 << entry.depth) - 1));
+}
+
+ForestDLT ClassifierBundle::Forest(const string& name) const {
+	vector<FlatDLT> trees;
+	for(int i = 0; i < Size(); ++i) {
+		if(name == entries(data)[i].name)
+			trees.push_back(Tree(i));
+	}
+	return ForestDLT(trees);
+}
+
+bool ClassifierBundle::Write(const string& path, const vector<string>& names,
+		const vector<FlatDLT>& trees) {
+	Header head;
+	memcpy(head.magic, MAGIC, sizeof(MAGIC));
+	head.byteOrder = BYTE_ORDER_MARK;
+	head.count = trees.size();
+	vector<Entry> table(trees.size());
+	vector<int32_t> body;
+	uint32_t offset = sizeof(Header) + table.size() * sizeof(Entry);
+	for(unsigned int i = 0; i < trees.size(); ++i) {
+		if(names[i].size() >= (size_t) NAME_SIZE)
+			return false;
+		memset(table[i].name, 0, NAME_SIZE);
+		strcpy(table[i].name, names[i].c_str());
+		table[i].depth = trees[i].Depth();
+		table[i].offset = offset + body.size() * sizeof(int32_t);
+		vector<int> splits, leaves;
+		trees[i].Export(splits, leaves);
+		body.insert(body.end(), splits.begin(), splits.end());
+		body.insert(body.end(), leaves.begin(), leaves.end());
+	}
+	// Replace the file in one go so a node mapping it never sees half of it
+	string temporary = path + ".tmp";
+	ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+	out.write((const char*) &head, sizeof(head));
+	if(!table.empty())
+		out.write((const char*) &table[0], table.size() * sizeof(Entry));
+	if(!body.empty())
+		out.write((const char*) &body[0], body.size() * sizeof(int32_t));
+	out.close();
+	return !out.fail() && rename(temporary.c_str(), path.c_str()) == 0;
+}
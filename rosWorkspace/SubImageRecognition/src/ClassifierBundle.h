@@ -0,0 +1,39 @@
+#ifndef _CLASSIFIER_BUNDLE_H
+#define _CLASSIFIER_BUNDLE_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "DLT.h"
+
+// Named FlatDLTs stored as they sit in memory in one binary file, which is
+// mapped rather than parsed. The file is a header, a table of entries giving
+// each tree's name, depth and where its splits and leaves are, then the
+// splits and leaves as native ints. Entries that share a name are the
+// trees of one forest.
+class ClassifierBundle {
+	public:
+		ClassifierBundle();
+		~ClassifierBundle();
+		// False if the file can't be mapped or isn't a whole bundle
+		bool Map(const std::string& path);
+		int Size() const;
+		std::string Name(int index) const;
+		// The index of the named tree, or -1 if there is none
+		int Find(const std::string& name) const;
+		FlatDLT Tree(int index) const;
+		// Every tree with the name, in the order they were written
+		ForestDLT Forest(const std::string& name) const;
+		static bool Write(const std::string& path, const std::vector<std::string>& names,
+				const std::vector<FlatDLT>& trees);
+	private:
+		ClassifierBundle(const ClassifierBundle&);
+		ClassifierBundle& operator=(const ClassifierBundle&);
+		void Unmap();
+		bool Valid() const;
+		const char* data;
+		size_t size;
+};
+
+#endif
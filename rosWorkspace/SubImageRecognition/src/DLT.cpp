@@ -1,4 +1,15 @@
 #include "DLT.h"
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DLT_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DLT_NEON
+#endif
 
 using namespace std;
 
@@ -22,4 +33,544 @@ DLT::DLT(istream& fin) {
 		lowSide = new DLT(fin);
 		highSide = new DLT(fin);
 	}
-}
\ No newline at end of file
+}
+FlatDLT::FlatDLT(const DLT& tree) {
+	depth = 0;
+	vector<pair<const DLT*, int> > stack(1, make_pair(&tree, 0));
+	while(!stack.empty()) {
+		const DLT* node = stack.back().first;
+		int level = stack.back().second;
+		stack.pop_back();
+		if(node->splitId < 0) {
+			depth = max(depth, level);
+		} else {
+			stack.push_back(make_pair(node->lowSide, level + 1));
+			stack.push_back(make_pair(node->highSide, level + 1));
+		}
+	}
+	nodes.resize((1 << depth) - 1);
+	leaves.resize(1 << depth);
+	Fill(tree, 0, 0);
+	CheckBatchable();
+	BuildWalk();
+}
+
+FlatDLT::FlatDLT(int depth, const int* splits, const int* leafLabels) {
+	this->depth = depth;
+	nodes.resize((1 << depth) - 1);
+	for(unsigned int i = 0; i < nodes.size(); ++i) {
+		nodes[i].splitId = splits[2 * i];
+		nodes[i].splitVal = splits[2 * i + 1];
+	}
+	leaves.assign(leafLabels, leafLabels + (1 << depth));
+	CheckBatchable();
+	BuildWalk();
+}
+
+void FlatDLT::Export(vector<int>& splits, vector<int>& leafLabels) const {
+	splits.resize(2 * nodes.size());
+	for(unsigned int i = 0; i < nodes.size(); ++i) {
+		splits[2 * i] = nodes[i].splitId;
+		splits[2 * i + 1] = nodes[i].splitVal;
+	}
+	leafLabels = leaves;
+}
+
+void FlatDLT::CheckBatchable() {
+	// Vector lanes hold node indices and labels in a single byte each
+	batchable = depth <= 7;
+	for(unsigned int i = 0; i < leaves.size(); ++i) {
+		batchable = batchable && leaves[i] >= 0 && leaves[i] <= UCHAR_MAX;
+	}
+}
+
+void FlatDLT::BuildWalk() {
+	walk = nodes;
+	for(unsigned int l = 0; l < leaves.size(); ++l) {
+		Node leaf = {-1, leaves[l]};
+		walk.push_back(leaf);
+	}
+	// Padding always goes low, so it ends at the leftmost leaf below it
+	for(unsigned int n = 0; n < nodes.size(); ++n) {
+		if(walk[n].splitId >= 0 && walk[n].splitVal == INT_MAX) {
+			unsigned int low = n;
+			while(low < nodes.size())
+				low = 2 * low + 1;
+			walk[n].splitId = -1;
+			walk[n].splitVal = walk[low].splitVal;
+		}
+	}
+}
+
+void FlatDLT::Fill(const DLT& tree, int index, int level) {
+	if(level == depth) {
+		leaves[index - nodes.size()] = tree.splitVal;
+	} else if(tree.splitId < 0) {
+		// Pad leaves above the bottom level with splits that always go low
+		nodes[index].splitId = 0;
+		nodes[index].splitVal = INT_MAX;
+		Fill(tree, 2 * index + 1, level + 1);
+		Fill(tree, 2 * index + 2, level + 1);
+	} else {
+		nodes[index].splitId = tree.splitId;
+		nodes[index].splitVal = tree.splitVal;
+		Fill(*tree.lowSide, 2 * index + 1, level + 1);
+		Fill(*tree.highSide, 2 * index + 2, level + 1);
+	}
+}
+
+int FlatDLT::Classify(const Sample& s) const {
+	const Node* node = &walk[0];
+	int index = 0;
+	while(node[index].splitId >= 0)
+		index = 2 * index + 1 + (s.iAttr[node[index].splitId] > node[index].splitVal);
+	return node[index].splitVal;
+}
+
+int FlatDLT::Depth() const {
+	return depth;
+}
+
+namespace {
+
+const int BATCH_LANES = 16;
+const int ROW_BLOCK = 256;
+// Room for a block of votes in every plane; blocks shrink as planes grow
+const int VOTE_BYTES = 16 * ROW_BLOCK;
+
+enum SplitKind {
+	SPLIT_NEVER,
+	SPLIT_ALWAYS,
+	SPLIT_COMPARE
+};
+
+#if defined(DLT_SSE2)
+typedef __m128i Lanes;
+inline Lanes lanesLoad(const unsigned char* p) { return _mm_loadu_si128((const __m128i*) p); }
+inline void lanesStore(unsigned char* p, Lanes v) { _mm_storeu_si128((__m128i*) p, v); }
+inline Lanes lanesSet(unsigned char v) { return _mm_set1_epi8((char) v); }
+inline Lanes lanesEqual(Lanes a, Lanes b) { return _mm_cmpeq_epi8(a, b); }
+inline Lanes lanesAnd(Lanes a, Lanes b) { return _mm_and_si128(a, b); }
+inline Lanes lanesOr(Lanes a, Lanes b) { return _mm_or_si128(a, b); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return _mm_add_epi8(a, b); }
+// SSE2 has no unsigned byte compare, but a saturating subtract is only zero
+// when a <= b
+inline Lanes lanesGreater(Lanes a, Lanes b) {
+	return _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(a, b), _mm_setzero_si128()),
+			_mm_set1_epi8(-1));
+}
+#elif defined(DLT_NEON)
+typedef uint8x16_t Lanes;
+inline Lanes lanesLoad(const unsigned char* p) { return vld1q_u8(p); }
+inline void lanesStore(unsigned char* p, Lanes v) { vst1q_u8(p, v); }
+inline Lanes lanesSet(unsigned char v) { return vdupq_n_u8(v); }
+inline Lanes lanesEqual(Lanes a, Lanes b) { return vceqq_u8(a, b); }
+inline Lanes lanesAnd(Lanes a, Lanes b) { return vandq_u8(a, b); }
+inline Lanes lanesOr(Lanes a, Lanes b) { return vorrq_u8(a, b); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return vaddq_u8(a, b); }
+inline Lanes lanesGreater(Lanes a, Lanes b) { return vcgtq_u8(a, b); }
+#endif
+
+}
+
+void FlatDLT::ClassifyBatch(int avgSat, int avgBright, const unsigned char* hue,
+		const unsigned char* sat, const unsigned char* bright,
+		int count, unsigned char* labels) const {
+	int done = 0;
+#if defined(DLT_SSE2) || defined(DLT_NEON)
+	if(batchable) {
+		// The frame averages are the same for every pixel, so splits on them
+		// and splits outside the byte range resolve before touching pixels
+		unsigned char kind[127], channel[127], threshold[127];
+		const int averages[2] = {avgSat, avgBright};
+		for(unsigned int n = 0; n < nodes.size(); ++n) {
+			const Node& node = nodes[n];
+			if(node.splitId < 2) {
+				kind[n] = averages[node.splitId] > node.splitVal ? SPLIT_ALWAYS : SPLIT_NEVER;
+			} else if(node.splitVal < 0) {
+				kind[n] = SPLIT_ALWAYS;
+			} else if(node.splitVal >= UCHAR_MAX) {
+				kind[n] = SPLIT_NEVER;
+			} else {
+				kind[n] = SPLIT_COMPARE;
+				channel[n] = node.splitId - 2;
+				threshold[n] = node.splitVal;
+			}
+		}
+		const int leafBase = nodes.size();
+		const Lanes zero = lanesSet(0), one = lanesSet(1), all = lanesSet(UCHAR_MAX);
+		// The last few pixels of a batch still go through the lanes, from a
+		// copy padded out with zeros, rather than walking the tree one by one
+		unsigned char tail[3][BATCH_LANES], tailLabels[BATCH_LANES];
+		for(; done < count; done += BATCH_LANES) {
+			const unsigned char *h = hue + done, *s = sat + done, *b = bright + done;
+			unsigned char* out = labels + done;
+			int left = count - done;
+			if(left < BATCH_LANES) {
+				memset(tail, 0, sizeof(tail));
+				memcpy(tail[0], h, left);
+				memcpy(tail[1], s, left);
+				memcpy(tail[2], b, left);
+				h = tail[0];
+				s = tail[1];
+				b = tail[2];
+				out = tailLabels;
+			}
+			const Lanes pixel[3] = {lanesLoad(h), lanesLoad(s), lanesLoad(b)};
+			// Every lane walks the tree in step; at each level a lane takes
+			// the decision of whichever node its index currently points at
+			Lanes index = zero;
+			for(int level = 0, first = 0; level < depth; ++level, first = 2 * first + 1) {
+				Lanes high = zero;
+				for(int n = first; n < 2 * first + 1; ++n) {
+					if(kind[n] == SPLIT_NEVER)
+						continue;
+					Lanes decision = kind[n] == SPLIT_ALWAYS ? all :
+							lanesGreater(pixel[channel[n]], lanesSet(threshold[n]));
+					Lanes here = level == 0 ? all : lanesEqual(index, lanesSet(n));
+					high = lanesOr(high, lanesAnd(here, decision));
+				}
+				index = lanesAdd(lanesAdd(index, index), lanesAdd(one, lanesAnd(high, one)));
+			}
+			Lanes label = zero;
+			for(unsigned int l = 0; l < leaves.size(); ++l) {
+				if(leaves[l] == 0)
+					continue;
+				label = lanesOr(label, lanesAnd(lanesEqual(index, lanesSet(leafBase + l)),
+						lanesSet(leaves[l])));
+			}
+			lanesStore(out, label);
+			if(out == tailLabels)
+				memcpy(labels + done, tailLabels, left);
+		}
+	}
+#endif
+	Sample sample;
+	sample.iAttr[0] = avgSat;
+	sample.iAttr[1] = avgBright;
+	for(; done < count; ++done) {
+		sample.iAttr[2] = hue[done];
+		sample.iAttr[3] = sat[done];
+		sample.iAttr[4] = bright[done];
+		labels[done] = Classify(sample);
+	}
+}
+
+void FlatDLT::ClassifyRow(int avgSat, int avgBright, const unsigned char* hsv,
+		int step, int count, unsigned char* labels) const {
+	unsigned char hue[ROW_BLOCK], sat[ROW_BLOCK], bright[ROW_BLOCK];
+	for(int start = 0; start < count; start += ROW_BLOCK) {
+		int size = min(ROW_BLOCK, count - start);
+		const unsigned char* pixel = hsv + start * step;
+		for(int i = 0; i < size; ++i, pixel += step) {
+			hue[i] = pixel[0];
+			sat[i] = pixel[1];
+			bright[i] = pixel[2];
+		}
+		ClassifyBatch(avgSat, avgBright, hue, sat, bright, size, labels + start);
+	}
+}
+
+ForestDLT::ForestDLT(istream& fin) {
+	int size = 1;
+	fin >> ws;
+	if(fin.peek() == 'F') {
+		string type;
+		fin >> type >> size;
+	}
+	for(int t = 0; t < size; ++t)
+		trees.push_back(FlatDLT(DLT(fin)));
+	CheckVotes();
+}
+
+ForestDLT::ForestDLT(const vector<FlatDLT>& trees):
+trees(trees)
+{
+	CheckVotes();
+}
+
+void ForestDLT::CheckVotes() {
+	voteLabels.clear();
+	fill(votePlane, votePlane + UCHAR_MAX + 1, 0);
+	// Vote counts are kept in a byte each
+	if(trees.size() > UCHAR_MAX)
+		return;
+	bool given[UCHAR_MAX + 1] = {true};
+	for(unsigned int t = 0; t < trees.size(); ++t) {
+		const vector<int>& leaves = trees[t].leaves;
+		for(unsigned int l = 0; l < leaves.size(); ++l) {
+			if(leaves[l] < 0 || leaves[l] > UCHAR_MAX)
+				return;
+			given[leaves[l]] = true;
+		}
+	}
+	for(int label = 0; label <= UCHAR_MAX; ++label) {
+		if(given[label]) {
+			votePlane[label] = voteLabels.size();
+			voteLabels.push_back(label);
+		}
+	}
+}
+
+int ForestDLT::Classify(const Sample& s) const {
+	if(trees.size() == 1)
+		return trees[0].Classify(s);
+	int labels[UCHAR_MAX + 1], votes[UCHAR_MAX + 1], distinct = 0;
+	for(unsigned int t = 0; t < trees.size(); ++t) {
+		int label = trees[t].Classify(s), i = 0;
+		while(i < distinct && labels[i] != label)
+			++i;
+		if(i == distinct) {
+			labels[distinct] = label;
+			votes[distinct++] = 0;
+		}
+		++votes[i];
+	}
+	int best = 0;
+	for(int i = 1; i < distinct; ++i) {
+		if(votes[i] > votes[best] || (votes[i] == votes[best] && labels[i] < labels[best]))
+			best = i;
+	}
+	return labels[best];
+}
+
+void ForestDLT::ClassifyBatch(int avgSat, int avgBright, const unsigned char* hue,
+		const unsigned char* sat, const unsigned char* bright,
+		int count, unsigned char* labels) const {
+	if(trees.size() == 1) {
+		trees[0].ClassifyBatch(avgSat, avgBright, hue, sat, bright, count, labels);
+		return;
+	}
+	if(voteLabels.empty()) {
+		Sample sample;
+		sample.iAttr[0] = avgSat;
+		sample.iAttr[1] = avgBright;
+		for(int i = 0; i < count; ++i) {
+			sample.iAttr[2] = hue[i];
+			sample.iAttr[3] = sat[i];
+			sample.iAttr[4] = bright[i];
+			labels[i] = Classify(sample);
+		}
+		return;
+	}
+	const int planes = voteLabels.size();
+	const int block = max(BATCH_LANES, min(ROW_BLOCK, VOTE_BYTES / planes));
+	unsigned char votes[VOTE_BYTES], voted[ROW_BLOCK];
+	for(int start = 0; start < count; start += block) {
+		int size = min(block, count - start);
+		fill(votes, votes + planes * block, 0);
+		for(unsigned int t = 0; t < trees.size(); ++t) {
+			trees[t].ClassifyBatch(avgSat, avgBright, hue + start, sat + start, bright + start,
+					size, voted);
+			for(int i = 0; i < size; ++i)
+				++votes[votePlane[voted[i]] * block + i];
+		}
+		// Planes go up by label, so the lowest label keeps a tie
+		for(int i = 0; i < size; ++i) {
+			int best = 0;
+			for(int p = 1; p < planes; ++p) {
+				if(votes[p * block + i] > votes[best * block + i])
+					best = p;
+			}
+			labels[start + i] = voteLabels[best];
+		}
+	}
+}
+
+int ForestDLT::Size() const {
+	return trees.size();
+}
+
+const FlatDLT& ForestDLT::Tree(int index) const {
+	return trees[index];
+}
+
+// Sorted split values a tree splits each attribute on, within the byte range
+static void splitValues(const vector<int>* splits, vector<int>* thresholds) {
+	for(int i = 0; i < ATTR; ++i) {
+		thresholds[i] = splits[i];
+		sort(thresholds[i].begin(), thresholds[i].end());
+		thresholds[i].erase(unique(thresholds[i].begin(), thresholds[i].end()), thresholds[i].end());
+	}
+}
+
+LutDLT::LutDLT(const ForestDLT& forest):
+forest(forest)
+,lastSatBin(-1)
+,lastBrightBin(-1)
+{
+	vector<vector<int> > treeSplits(forest.Size() * ATTR);
+	for(int t = 0; t < forest.Size(); ++t) {
+		const vector<FlatDLT::Node>& nodes = forest.Tree(t).nodes;
+		for(unsigned int n = 0; n < nodes.size(); ++n) {
+			if(nodes[n].splitVal >= 0 && nodes[n].splitVal < UCHAR_MAX) {
+				treeSplits[t * ATTR + nodes[n].splitId].push_back(nodes[n].splitVal);
+			}
+		}
+	}
+	vector<int> splits[ATTR];
+	for(unsigned int i = 0; i < treeSplits.size(); ++i) {
+		splits[i % ATTR].insert(splits[i % ATTR].end(), treeSplits[i].begin(), treeSplits[i].end());
+	}
+	splitValues(splits, thresholds);
+	// A value's bin is how many thresholds it is above; the table is laid
+	// out hue-major so each channel's bin is premultiplied by its stride
+	int stride = 1;
+	for(int c = 2; c >= 0; --c) {
+		const vector<int>& split = thresholds[c + 2];
+		for(int value = 0, bin = 0; value < 256; ++value) {
+			while(bin < (int) split.size() && value > split[bin])
+				++bin;
+			bins[c][value] = bin * stride;
+		}
+		stride *= split.size() + 1;
+	}
+	table.resize(stride);
+
+	// A forest's table is far bigger than any of its trees', so rather than
+	// running every tree for every entry, each tree fills a table of its own
+	// and the forest's entries count their votes from those. To begin with
+	// every tree votes for 0 everywhere, which is the first plane.
+	if(forest.Size() == 1 || forest.voteLabels.empty())
+		return;
+	members.resize(forest.Size());
+	for(int t = 0; t < forest.Size(); ++t) {
+		Member& member = members[t];
+		vector<int> own[ATTR];
+		splitValues(&treeSplits[t * ATTR], own);
+		member.averages[0] = own[0];
+		member.averages[1] = own[1];
+		member.averageBin = -1;
+		int memberStride = 1;
+		for(int c = 2; c >= 0; --c) {
+			const vector<int>& split = own[c + 2];
+			member.values[c].push_back(0);
+			for(unsigned int i = 0; i < split.size(); ++i)
+				member.values[c].push_back(split[i] + 1);
+			for(unsigned int bin = 0; bin <= thresholds[c + 2].size(); ++bin) {
+				int value = bin ? thresholds[c + 2][bin - 1] + 1 : 0;
+				int memberBin = upper_bound(split.begin(), split.end(), value - 1) - split.begin();
+				member.bins[c].push_back(memberBin * memberStride);
+			}
+			memberStride *= split.size() + 1;
+		}
+		member.table.assign(memberStride, 0);
+	}
+	const int planes = forest.voteLabels.size();
+	votes.assign(table.size() * planes, 0);
+	for(unsigned int cell = 0; cell < table.size(); ++cell)
+		votes[cell * planes] = members.size();
+}
+
+// Which bin of a pair of saturation and value thresholds the averages fall in
+static int averageBin(const vector<int>& sats, const vector<int>& brights, int avgSat, int avgBright) {
+	int satBin = upper_bound(sats.begin(), sats.end(), avgSat - 1) - sats.begin();
+	int brightBin = upper_bound(brights.begin(), brights.end(), avgBright - 1) - brights.begin();
+	return satBin * (brights.size() + 1) + brightBin;
+}
+
+int LutDLT::AverageBin(int avgSat, int avgBright) const {
+	return averageBin(thresholds[0], thresholds[1], avgSat, avgBright);
+}
+
+void LutDLT::Update(int avgSat, int avgBright) {
+	if(!members.empty()) {
+		// Each tree only changes when the averages cross one of its own few
+		// thresholds, so jitter in the averages leaves most trees alone
+		vector<unsigned char> before;
+		for(unsigned int t = 0; t < members.size(); ++t) {
+			Member& member = members[t];
+			int bin = averageBin(member.averages[0], member.averages[1], avgSat, avgBright);
+			if(bin == member.averageBin)
+				continue;
+			member.averageBin = bin;
+			before = member.table;
+			FillMember(member, forest.Tree(t), avgSat, avgBright);
+			if(member.table != before)
+				CountVotes(member, before);
+		}
+		return;
+	}
+	int satBin = upper_bound(thresholds[0].begin(), thresholds[0].end(), avgSat - 1) - thresholds[0].begin();
+	int brightBin = upper_bound(thresholds[1].begin(), thresholds[1].end(), avgBright - 1) - thresholds[1].begin();
+	if(satBin == lastSatBin && brightBin == lastBrightBin)
+		return;
+	lastSatBin = satBin;
+	lastBrightBin = brightBin;
+	Fill(avgSat, avgBright);
+}
+
+void LutDLT::Fill(int avgSat, int avgBright) {
+	// Classify one representative value from every bin: zero for the lowest
+	// bin, or one above the threshold that opens the bin
+	Sample sample;
+	sample.iAttr[0] = avgSat;
+	sample.iAttr[1] = avgBright;
+	int cell = 0;
+	for(unsigned int h = 0; h <= thresholds[2].size(); ++h) {
+		sample.iAttr[2] = h ? thresholds[2][h - 1] + 1 : 0;
+		for(unsigned int s = 0; s <= thresholds[3].size(); ++s) {
+			sample.iAttr[3] = s ? thresholds[3][s - 1] + 1 : 0;
+			for(unsigned int v = 0; v <= thresholds[4].size(); ++v) {
+				sample.iAttr[4] = v ? thresholds[4][v - 1] + 1 : 0;
+				table[cell++] = forest.Classify(sample);
+			}
+		}
+	}
+}
+
+void LutDLT::FillMember(Member& member, const FlatDLT& tree, int avgSat, int avgBright) {
+	Sample sample;
+	sample.iAttr[0] = avgSat;
+	sample.iAttr[1] = avgBright;
+	int cell = 0;
+	for(unsigned int h = 0; h < member.values[0].size(); ++h) {
+		sample.iAttr[2] = member.values[0][h];
+		for(unsigned int s = 0; s < member.values[1].size(); ++s) {
+			sample.iAttr[3] = member.values[1][s];
+			for(unsigned int v = 0; v < member.values[2].size(); ++v) {
+				sample.iAttr[4] = member.values[2][v];
+				member.table[cell++] = forest.votePlane[tree.Classify(sample)];
+			}
+		}
+	}
+}
+
+// Moves a tree's vote in every cell where it changed from before, and picks
+// those cells' labels again, the lowest label keeping a tie
+void LutDLT::CountVotes(const Member& member, const vector<unsigned char>& before) {
+	const int planes = forest.voteLabels.size();
+	int cell = 0;
+	for(unsigned int h = 0; h <= thresholds[2].size(); ++h) {
+		for(unsigned int s = 0; s <= thresholds[3].size(); ++s) {
+			int row = member.bins[0][h] + member.bins[1][s];
+			const unsigned char* was = &before[row];
+			const unsigned char* is = &member.table[row];
+			for(unsigned int v = 0; v <= thresholds[4].size(); ++v, ++cell) {
+				int from = was[member.bins[2][v]], to = is[member.bins[2][v]];
+				if(from == to)
+					continue;
+				unsigned char* count = &votes[cell * planes];
+				--count[from];
+				++count[to];
+				int best = 0;
+				for(int p = 1; p < planes; ++p) {
+					if(count[p] > count[best])
+						best = p;
+				}
+				table[cell] = forest.voteLabels[best];
+			}
+		}
+	}
+}
+
+void LutDLT::ClassifyBatch(const unsigned char* hue, const unsigned char* sat,
+		const unsigned char* bright, int count, unsigned char* labels) const {
+	for(int i = 0; i < count; ++i) {
+		labels[i] = Classify(hue[i], sat[i], bright[i]);
+	}
+}
+
+int LutDLT::TableSize() const {
+	return table.size();
+}
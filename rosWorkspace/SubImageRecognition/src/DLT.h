@@ -1,4 +1,8 @@
+#ifndef _DLT_H
+#define _DLT_H
+
 #include <string>
+#include <vector>
 #include <fstream>
 
 const int ATTR=5;
@@ -19,4 +23,133 @@ class DLT {
 		int splitVal;
 		DLT* lowSide;
 		DLT* highSide;
+		friend class FlatDLT;
+};
+
+// The same decisions as a DLT laid out as a complete binary tree in
+// breadth-first order, so classifying walks an array by index arithmetic
+// instead of chasing node pointers. Leaves above the full depth are padded
+// with splits that always go low.
+class FlatDLT {
+	public:
+		FlatDLT(const DLT& tree);
+		// Rebuild a tree of the given depth from its splits, as splitId and
+		// splitVal pairs in node order, and its 2^depth leaf labels
+		FlatDLT(int depth, const int* splits, const int* leafLabels);
+		int Classify(const Sample& s) const;
+		// Classify count pixels given as separate hue, saturation and value
+		// planes that share one pair of frame averages. Runs 16 pixels at a
+		// time with SSE2 or NEON where available and gives exactly the same
+		// labels as Classify.
+		void ClassifyBatch(int avgSat, int avgBright, const unsigned char* hue,
+				const unsigned char* sat, const unsigned char* bright,
+				int count, unsigned char* labels) const;
+		// Classify count interleaved HSV pixels that are step bytes apart,
+		// such as every SAMPLE_SIZEth pixel of one row of a CV_8UC3 image
+		void ClassifyRow(int avgSat, int avgBright, const unsigned char* hsv,
+				int step, int count, unsigned char* labels) const;
+		int Depth() const;
+		// The splits and leaf labels the second constructor takes
+		void Export(std::vector<int>& splits, std::vector<int>& leafLabels) const;
+	private:
+		struct Node {
+			int splitId;
+			int splitVal;
+		};
+		void Fill(const DLT& tree, int index, int level);
+		void CheckBatchable();
+		void BuildWalk();
+		int depth;
+		bool batchable;
+		std::vector<Node> nodes;
+		std::vector<int> leaves;
+		// nodes then leaves in one array for Classify, with a splitId of -1
+		// and the label as splitVal wherever a real leaf or padding starts,
+		// so a walk stops there instead of going on down to the bottom
+		std::vector<Node> walk;
+		friend class ForestDLT;
+		friend class LutDLT;
+};
+
+// FlatDLTs that each vote for a label, the most votes winning and ties going
+// to the lowest label. Read from the trees one after another behind a
+// "Forest n" line, as DLTGen saves them, or from a lone tree, which makes a
+// forest of one.
+class ForestDLT {
+	public:
+		ForestDLT(std::istream& fin);
+		ForestDLT(const std::vector<FlatDLT>& trees);
+		int Classify(const Sample& s) const;
+		// Classifies with each tree in turn through FlatDLT::ClassifyBatch and
+		// counts the votes for each label in a plane of its own. Gives exactly
+		// the same labels as Classify.
+		void ClassifyBatch(int avgSat, int avgBright, const unsigned char* hue,
+				const unsigned char* sat, const unsigned char* bright,
+				int count, unsigned char* labels) const;
+		int Size() const;
+		const FlatDLT& Tree(int index) const;
+	private:
+		void CheckVotes();
+		std::vector<FlatDLT> trees;
+		// Every label a tree can give, and 0, in ascending order, so the
+		// first plane with the most votes wins. Empty if votes can't be
+		// counted in bytes, which DLTGen's trees always can.
+		std::vector<int> voteLabels;
+		// Index into voteLabels of each byte label
+		unsigned char votePlane[256];
+		friend class LutDLT;
 };
+
+// A ForestDLT baked into a lookup table over (H,S,V) for one pair of frame
+// averages. Each channel is first mapped to its bin between the thresholds
+// the trees split that channel on, which keeps the table exact and small
+// enough to stay in cache for a single tree. A forest's table grows with
+// every threshold its trees add, so each of its trees also keeps a table of
+// its own, which Update only refills when the averages cross one of that
+// tree's thresholds, and the forest's table counts how each cell's votes
+// change.
+class LutDLT {
+	public:
+		LutDLT(const ForestDLT& forest);
+		void Update(int avgSat, int avgBright);
+		// Which of the tree's bins the pair of frame averages falls in. Labels
+		// only depend on the averages through this.
+		int AverageBin(int avgSat, int avgBright) const;
+		int Classify(unsigned char hue, unsigned char sat, unsigned char bright) const {
+			return table[bins[0][hue] + bins[1][sat] + bins[2][bright]];
+		}
+		void ClassifyBatch(const unsigned char* hue, const unsigned char* sat,
+				const unsigned char* bright, int count, unsigned char* labels) const;
+		int TableSize() const;
+	private:
+		// One tree of a forest, with a table of which vote plane it picks
+		// over just its own thresholds
+		struct Member {
+			std::vector<unsigned char> table;
+			// A value from each of the tree's bins on each channel
+			std::vector<int> values[3];
+			// The tree's table offset for each of the forest's bins
+			std::vector<int> bins[3];
+			// The tree's own thresholds on the averages, and which of its
+			// bins the averages were in when table was filled
+			std::vector<int> averages[2];
+			int averageBin;
+		};
+		void Fill(int avgSat, int avgBright);
+		void FillMember(Member& member, const FlatDLT& tree, int avgSat, int avgBright);
+		void CountVotes(const Member& member, const std::vector<unsigned char>& before);
+		ForestDLT forest;
+		// Sorted split values on each of the ATTR attributes
+		std::vector<int> thresholds[ATTR];
+		// Table offset contributed by each hue, saturation and value
+		int bins[3][256];
+		// Empty unless the forest can be filled by counting votes
+		std::vector<Member> members;
+		// How many trees pick each vote plane in each cell of table
+		std::vector<unsigned char> votes;
+		int lastSatBin;
+		int lastBrightBin;
+		std::vector<unsigned char> table;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "DLT.h"
+
+using namespace std;
+
+// Times the ways of classifying a full 640x480 HSV frame through each tree
+// given on the command line and checks they all agree with the pointer tree.
+// For a forest, the pointer tree is its first tree, and the forest's own ways
+// are checked against voting tree by tree.
+//
+//   DLTBench gate.tree path.tree ...
+
+const int FRAME_WIDTH = 640;
+const int FRAME_HEIGHT = 480;
+const int ITERATIONS = 20;
+const int AVG_SAT = 90;
+const int AVG_BRIGHT = 120;
+
+double now() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void report(const char* name, double seconds, int mismatches) {
+	printf("  %-14s %8.3f ms/frame  %7.1f Mpx/s  %d mismatches\n", name,
+			seconds * 1000 / ITERATIONS,
+			(double) FRAME_WIDTH * FRAME_HEIGHT * ITERATIONS / seconds / 1000000,
+			mismatches);
+}
+
+int mismatches(const vector<unsigned char>& labels, const vector<unsigned char>& expected) {
+	int count = 0;
+	for (unsigned int i = 0; i < labels.size(); i++) {
+		count += labels[i] != expected[i];
+	}
+	return count;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s tree...\n", argv[0]);
+		return 1;
+	}
+
+	// Blocky noise so neighbouring pixels look somewhat alike, as in a real frame
+	const int pixels = FRAME_WIDTH * FRAME_HEIGHT;
+	vector<unsigned char> frame(pixels * 3);
+	srand(1);
+	for (int i = 0; i < pixels; i++) {
+		if (i % 8 == 0) {
+			frame[i * 3] = rand() % 180;
+			frame[i * 3 + 1] = rand() % 256;
+			frame[i * 3 + 2] = rand() % 256;
+		} else {
+			frame[i * 3] = frame[i * 3 - 3];
+			frame[i * 3 + 1] = frame[i * 3 - 2];
+			frame[i * 3 + 2] = frame[i * 3 - 1];
+		}
+	}
+
+	// The same frame as separate planes, for the forest's batches
+	vector<unsigned char> hues(pixels), sats(pixels), brights(pixels);
+	for (int i = 0; i < pixels; i++) {
+		hues[i] = frame[i * 3];
+		sats[i] = frame[i * 3 + 1];
+		brights[i] = frame[i * 3 + 2];
+	}
+
+	vector<unsigned char> expected(pixels), voted(pixels), labels(pixels);
+	for (int t = 1; t < argc; t++) {
+		ifstream file(argv[t]);
+		if (!file) {
+			fprintf(stderr, "cannot open %s\n", argv[t]);
+			return 1;
+		}
+		ForestDLT forest(file);
+		// The pointer tree is the forest's first, as a single tree to beat
+		ifstream first(argv[t]);
+		string type;
+		int size;
+		if (forest.Size() > 1) {
+			first >> type >> size;
+		}
+		DLT tree(first);
+		const FlatDLT& flat = forest.Tree(0);
+		LutDLT lut(forest);
+		printf("%s (%d trees, depth %d, %d table entries)\n", argv[t], forest.Size(),
+				flat.Depth(), lut.TableSize());
+
+		Sample sample;
+		sample.iAttr[0] = AVG_SAT;
+		sample.iAttr[1] = AVG_BRIGHT;
+		double start = now();
+		for (int n = 0; n < ITERATIONS; n++) {
+			for (int i = 0; i < pixels; i++) {
+				sample.iAttr[2] = frame[i * 3];
+				sample.iAttr[3] = frame[i * 3 + 1];
+				sample.iAttr[4] = frame[i * 3 + 2];
+				expected[i] = tree.Classify(sample);
+			}
+		}
+		report("pointer tree", now() - start, 0);
+
+		start = now();
+		for (int n = 0; n < ITERATIONS; n++) {
+			for (int i = 0; i < pixels; i++) {
+				sample.iAttr[2] = frame[i * 3];
+				sample.iAttr[3] = frame[i * 3 + 1];
+				sample.iAttr[4] = frame[i * 3 + 2];
+				labels[i] = flat.Classify(sample);
+			}
+		}
+		double elapsed = now() - start;
+		report("flat tree", elapsed, mismatches(labels, expected));
+
+		start = now();
+		for (int n = 0; n < ITERATIONS; n++) {
+			for (int row = 0; row < FRAME_HEIGHT; row++) {
+				flat.ClassifyRow(AVG_SAT, AVG_BRIGHT, &frame[row * FRAME_WIDTH * 3], 3,
+						FRAME_WIDTH, &labels[row * FRAME_WIDTH]);
+			}
+		}
+		elapsed = now() - start;
+		report("batched rows", elapsed, mismatches(labels, expected));
+
+		voted = expected;
+		if (forest.Size() > 1) {
+			start = now();
+			for (int n = 0; n < ITERATIONS; n++) {
+				for (int i = 0; i < pixels; i++) {
+					sample.iAttr[2] = frame[i * 3];
+					sample.iAttr[3] = frame[i * 3 + 1];
+					sample.iAttr[4] = frame[i * 3 + 2];
+					voted[i] = forest.Classify(sample);
+				}
+			}
+			report("forest", now() - start, 0);
+
+			start = now();
+			for (int n = 0; n < ITERATIONS; n++) {
+				forest.ClassifyBatch(AVG_SAT, AVG_BRIGHT, &hues[0], &sats[0], &brights[0],
+						pixels, &labels[0]);
+			}
+			elapsed = now() - start;
+			report("forest batched", elapsed, mismatches(labels, voted));
+		}
+
+		start = now();
+		for (int n = 0; n < ITERATIONS; n++) {
+			lut.Update(AVG_SAT, AVG_BRIGHT);
+			for (int i = 0; i < pixels; i++) {
+				labels[i] = lut.Classify(frame[i * 3], frame[i * 3 + 1], frame[i * 3 + 2]);
+			}
+		}
+		elapsed = now() - start;
+		report("lookup table", elapsed, mismatches(labels, voted));
+	}
+	return 0;
+}
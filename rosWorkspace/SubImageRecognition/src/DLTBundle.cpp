@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ClassifierBundle.h"
+#include "DLT.h"
+
+using namespace std;
+
+// Packs .tree files into one bundle for ImageRecognition to map. Each tree,
+// or each of a forest's trees, is named by its file name without the
+// directory or ".tree".
+//
+//   DLTBundle classifiers.bundle gate.tree redbuoy.tree ...
+
+string treeName(const string& path) {
+	string name = path.substr(path.find_last_of('/') + 1);
+	if (name.size() > 5 && name.compare(name.size() - 5, 5, ".tree") == 0) {
+		name.erase(name.size() - 5);
+	}
+	return name;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s bundle tree...\n", argv[0]);
+		return 1;
+	}
+
+	vector<string> names;
+	vector<FlatDLT> trees;
+	for (int t = 2; t < argc; t++) {
+		ifstream file(argv[t]);
+		if (!file) {
+			fprintf(stderr, "cannot open %s\n", argv[t]);
+			return 1;
+		}
+		// A forest's trees all go in under its name
+		ForestDLT forest(file);
+		for (int i = 0; i < forest.Size(); i++) {
+			names.push_back(treeName(argv[t]));
+			trees.push_back(forest.Tree(i));
+		}
+		printf("%s as %s (%d trees, depth %d)\n", argv[t], names.back().c_str(), forest.Size(),
+				trees.back().Depth());
+	}
+	if (!ClassifierBundle::Write(argv[1], names, trees)) {
+		fprintf(stderr, "cannot write %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
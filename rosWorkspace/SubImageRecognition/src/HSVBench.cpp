@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "HSVSampler.h"
+
+using namespace cv;
+using namespace std;
+
+// Times converting a 640x480 BGR frame to sampled HSV planes by converting
+// the whole frame with cvtColor and picking out every SAMPLE_SIZE'th pixel,
+// against converting only those pixels with sampleHSV, and checks they give
+// the same samples and averages at every offset.
+//
+//   HSVBench
+
+const int FRAME_WIDTH = 640;
+const int FRAME_HEIGHT = 480;
+const int ITERATIONS = 100;
+const int SAMPLE_SIZE = 4;
+
+double now() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void report(const char* name, double seconds, int mismatches) {
+	printf("  %-14s %8.3f ms/frame  %d mismatches\n", name,
+			seconds * 1000 / ITERATIONS, mismatches);
+}
+
+// The way frames were sampled before sampleHSV
+int sampleConverted(const Mat& hsv, int offset, unsigned char* hues, unsigned char* sats,
+		unsigned char* brights, int& avgHue, int& avgSat, int& avgBright) {
+	int n = 0, hue = 0, sat = 0, bright = 0;
+	for (int i = offset; i < hsv.rows; i += SAMPLE_SIZE) {
+		const Vec3b* row = hsv.ptr<Vec3b>(i);
+		for (int j = offset; j < hsv.cols; j += SAMPLE_SIZE, n++) {
+			hues[n] = row[j][0];
+			sats[n] = row[j][1];
+			brights[n] = row[j][2];
+			hue += hues[n];
+			sat += sats[n];
+			bright += brights[n];
+		}
+	}
+	avgHue = hue / n;
+	avgSat = sat / n;
+	avgBright = bright / n;
+	return n;
+}
+
+int main(int argc, char **argv) {
+	// Random colours, with some greys and some pixels with two equal channels
+	// to cover the ties in picking the largest channel
+	Mat frame(FRAME_HEIGHT, FRAME_WIDTH, CV_8UC3);
+	srand(1);
+	for (int i = 0; i < FRAME_HEIGHT; i++) {
+		uchar* pixel = frame.ptr<uchar>(i);
+		for (int j = 0; j < FRAME_WIDTH; j++, pixel += 3) {
+			pixel[0] = rand() % 256;
+			pixel[1] = rand() % 4 ? rand() % 256 : pixel[0];
+			pixel[2] = rand() % 4 ? rand() % 256 : pixel[1];
+		}
+	}
+
+	int samples = sampleColumns(FRAME_WIDTH, 0, SAMPLE_SIZE) * sampleColumns(FRAME_HEIGHT, 0, SAMPLE_SIZE);
+	vector<unsigned char> hues(samples), sats(samples), brights(samples);
+	vector<unsigned char> expectedHues(samples), expectedSats(samples), expectedBrights(samples);
+	int avgHue, avgSat, avgBright, expectedHue, expectedSat, expectedBright;
+	Mat hsv;
+
+	double converting = 0, sampling = 0;
+	int mismatches = 0;
+	for (int n = 0; n < ITERATIONS; n++) {
+		int offset = n % SAMPLE_SIZE;
+		double start = now();
+		cvtColor(frame, hsv, CV_BGR2HSV);
+		int count = sampleConverted(hsv, offset, &expectedHues[0], &expectedSats[0], &expectedBrights[0],
+				expectedHue, expectedSat, expectedBright);
+		converting += now() - start;
+
+		start = now();
+		sampleHSV(frame, offset, SAMPLE_SIZE, &hues[0], &sats[0], &brights[0],
+				avgHue, avgSat, avgBright);
+		sampling += now() - start;
+
+		for (int i = 0; i < count; i++) {
+			mismatches += hues[i] != expectedHues[i] || sats[i] != expectedSats[i]
+					|| brights[i] != expectedBrights[i];
+		}
+		mismatches += avgHue != expectedHue || avgSat != expectedSat || avgBright != expectedBright;
+	}
+	report("cvtColor", converting, 0);
+	report("sampleHSV", sampling, mismatches);
+	return mismatches != 0;
+}
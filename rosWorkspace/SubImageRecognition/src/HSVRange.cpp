@@ -0,0 +1,90 @@
+#include "HSVRange.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RANGE_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RANGE_NEON
+#endif
+
+namespace {
+
+const int LANES = 16;
+
+inline bool within(unsigned char x, unsigned char low, unsigned char high) {
+	return x >= low && x <= high;
+}
+
+#if defined(RANGE_SSE2)
+typedef __m128i Lanes;
+inline Lanes lanesLoad(const unsigned char* p) { return _mm_loadu_si128((const __m128i*) p); }
+inline Lanes lanesSet(unsigned char v) { return _mm_set1_epi8((char) v); }
+// All ones where a >= b: the saturating b - a is zero
+inline Lanes lanesAtLeast(Lanes a, Lanes b) {
+	return _mm_cmpeq_epi8(_mm_subs_epu8(b, a), _mm_setzero_si128());
+}
+inline Lanes lanesAnd(Lanes a, Lanes b) { return _mm_and_si128(a, b); }
+inline Lanes lanesOr(Lanes a, Lanes b) { return _mm_or_si128(a, b); }
+inline void lanesStore(unsigned char* p, Lanes v) { _mm_storeu_si128((__m128i*) p, v); }
+#elif defined(RANGE_NEON)
+typedef uint8x16_t Lanes;
+inline Lanes lanesLoad(const unsigned char* p) { return vld1q_u8(p); }
+inline Lanes lanesSet(unsigned char v) { return vdupq_n_u8(v); }
+inline Lanes lanesAtLeast(Lanes a, Lanes b) { return vcgeq_u8(a, b); }
+inline Lanes lanesAnd(Lanes a, Lanes b) { return vandq_u8(a, b); }
+inline Lanes lanesOr(Lanes a, Lanes b) { return vorrq_u8(a, b); }
+inline void lanesStore(unsigned char* p, Lanes v) { vst1q_u8(p, v); }
+#endif
+
+}
+
+HSVRange::HSVRange():
+hMin(0)
+,hMax(0)
+,sMin(0)
+,sMax(0)
+,vMin(0)
+,vMax(0)
+{
+}
+
+HSVRange::HSVRange(int hMin, int hMax, int sMin, int sMax, int vMin, int vMax):
+hMin(hMin)
+,hMax(hMax)
+,sMin(sMin)
+,sMax(sMax)
+,vMin(vMin)
+,vMax(vMax)
+{
+}
+
+bool HSVRange::isSet() const {
+	return hMin || hMax || sMin || sMax || vMin || vMax;
+}
+
+void HSVRange::classify(const unsigned char* hue, const unsigned char* sat,
+		const unsigned char* bright, int count, unsigned char label,
+		unsigned char* labels) const {
+	bool wraps = hMin > hMax;
+	int i = 0;
+#if defined(RANGE_SSE2) || defined(RANGE_NEON)
+	const Lanes lowH = lanesSet(hMin), highH = lanesSet(hMax);
+	const Lanes lowS = lanesSet(sMin), highS = lanesSet(sMax);
+	const Lanes lowV = lanesSet(vMin), highV = lanesSet(vMax);
+	const Lanes labelLanes = lanesSet(label);
+	for (; i + LANES <= count; i += LANES) {
+		Lanes h = lanesLoad(hue + i), s = lanesLoad(sat + i), v = lanesLoad(bright + i);
+		Lanes inHue = wraps ? lanesOr(lanesAtLeast(h, lowH), lanesAtLeast(highH, h))
+				: lanesAnd(lanesAtLeast(h, lowH), lanesAtLeast(highH, h));
+		Lanes in = lanesAnd(inHue, lanesAnd(
+				lanesAnd(lanesAtLeast(s, lowS), lanesAtLeast(highS, s)),
+				lanesAnd(lanesAtLeast(v, lowV), lanesAtLeast(highV, v))));
+		lanesStore(labels + i, lanesAnd(in, labelLanes));
+	}
+#endif
+	for (; i < count; i++) {
+		bool inHue = wraps ? hue[i] >= hMin || hue[i] <= hMax : within(hue[i], hMin, hMax);
+		labels[i] = inHue && within(sat[i], sMin, sMax) && within(bright[i], vMin, vMax) ? label : 0;
+	}
+}
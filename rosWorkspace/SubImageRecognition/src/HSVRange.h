@@ -0,0 +1,25 @@
+#ifndef _HSV_RANGE_H
+#define _HSV_RANGE_H
+
+// Bounds on hue, saturation and value, as an ImgRecAlgorithm carries them.
+// A pixel is in range when all three channels are within their bounds,
+// inclusive. A hue range whose minimum is above its maximum wraps round
+// through 0, as red does. Classifying costs the same whatever the bounds,
+// unlike a tree, which makes it a cheap fallback and a baseline to compare
+// trees against.
+class HSVRange {
+public:
+	HSVRange();
+	HSVRange(int hMin, int hMax, int sMin, int sMax, int vMin, int vMax);
+	// False until bounds have been given
+	bool isSet() const;
+	// Give each of count pixels, as separate planes, the label if it is in
+	// range or else 0. Runs 16 pixels at a time with SSE2 or NEON.
+	void classify(const unsigned char* hue, const unsigned char* sat,
+			const unsigned char* bright, int count, unsigned char label,
+			unsigned char* labels) const;
+
+	unsigned char hMin, hMax, sMin, sMax, vMin, vMax;
+};
+
+#endif
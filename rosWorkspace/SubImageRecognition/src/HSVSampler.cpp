@@ -0,0 +1,195 @@
+#include "HSVSampler.h"
+#include <stdlib.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HSV_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HSV_NEON
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+// Samples are converted a block at a time: gathered into planes, run
+// through the vector stage for their extremes, then finished with the
+// reciprocal tables
+const int BLOCK = 256;
+const int LANES = 16;
+
+// Fixed point reciprocals built the way OpenCV builds them, so every result
+// matches cvtColor to the bit
+const int HSV_SHIFT = 12;
+const int HSV_ROUND = 1 << (HSV_SHIFT - 1);
+const int HUE_RANGE = 180;
+
+struct Reciprocals {
+	int sat[256];
+	int hue[256];
+	Reciprocals() {
+		sat[0] = hue[0] = 0;
+		for (int i = 1; i < 256; i++) {
+			sat[i] = cvRound((255 << HSV_SHIFT) / (1. * i));
+			hue[i] = cvRound((HUE_RANGE << HSV_SHIFT) / (6. * i));
+		}
+	}
+};
+const Reciprocals reciprocals;
+
+// For count samples of planar b, g and r, the value (largest channel), its
+// distance from the smallest channel, and the hue before scaling: where the
+// largest channel sits on the colour wheel plus how far past it the next
+// one pulls
+void extremes(const uchar* b, const uchar* g, const uchar* r, int count,
+		uchar* value, uchar* diff, short* hue) {
+	int i = 0;
+#if defined(HSV_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + LANES <= count; i += LANES) {
+		__m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+		__m128i vg = _mm_loadu_si128((const __m128i*) (g + i));
+		__m128i vr = _mm_loadu_si128((const __m128i*) (r + i));
+		__m128i v = _mm_max_epu8(_mm_max_epu8(vb, vg), vr);
+		__m128i d = _mm_subs_epu8(v, _mm_min_epu8(_mm_min_epu8(vb, vg), vr));
+		__m128i isR = _mm_cmpeq_epi8(v, vr);
+		__m128i isG = _mm_cmpeq_epi8(v, vg);
+		_mm_storeu_si128((__m128i*) (value + i), v);
+		_mm_storeu_si128((__m128i*) (diff + i), d);
+		for (int half = 0; half < 2; half++) {
+			__m128i b16 = half ? _mm_unpackhi_epi8(vb, zero) : _mm_unpacklo_epi8(vb, zero);
+			__m128i g16 = half ? _mm_unpackhi_epi8(vg, zero) : _mm_unpacklo_epi8(vg, zero);
+			__m128i r16 = half ? _mm_unpackhi_epi8(vr, zero) : _mm_unpacklo_epi8(vr, zero);
+			__m128i d16 = half ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+			__m128i r8 = half ? _mm_unpackhi_epi8(isR, isR) : _mm_unpacklo_epi8(isR, isR);
+			__m128i g8 = half ? _mm_unpackhi_epi8(isG, isG) : _mm_unpacklo_epi8(isG, isG);
+			__m128i fromR = _mm_sub_epi16(g16, b16);
+			__m128i fromG = _mm_add_epi16(_mm_sub_epi16(b16, r16), _mm_slli_epi16(d16, 1));
+			__m128i fromB = _mm_add_epi16(_mm_sub_epi16(r16, g16), _mm_slli_epi16(d16, 2));
+			__m128i h = _mm_or_si128(_mm_and_si128(g8, fromG), _mm_andnot_si128(g8, fromB));
+			h = _mm_or_si128(_mm_and_si128(r8, fromR), _mm_andnot_si128(r8, h));
+			_mm_storeu_si128((__m128i*) (hue + i + half * 8), h);
+		}
+	}
+#elif defined(HSV_NEON)
+	for (; i + LANES <= count; i += LANES) {
+		uint8x16_t vb = vld1q_u8(b + i);
+		uint8x16_t vg = vld1q_u8(g + i);
+		uint8x16_t vr = vld1q_u8(r + i);
+		uint8x16_t v = vmaxq_u8(vmaxq_u8(vb, vg), vr);
+		uint8x16_t d = vsubq_u8(v, vminq_u8(vminq_u8(vb, vg), vr));
+		uint8x16_t isR = vceqq_u8(v, vr);
+		uint8x16_t isG = vceqq_u8(v, vg);
+		vst1q_u8(value + i, v);
+		vst1q_u8(diff + i, d);
+		for (int half = 0; half < 2; half++) {
+			int16x8_t b16 = vreinterpretq_s16_u16(vmovl_u8(half ? vget_high_u8(vb) : vget_low_u8(vb)));
+			int16x8_t g16 = vreinterpretq_s16_u16(vmovl_u8(half ? vget_high_u8(vg) : vget_low_u8(vg)));
+			int16x8_t r16 = vreinterpretq_s16_u16(vmovl_u8(half ? vget_high_u8(vr) : vget_low_u8(vr)));
+			int16x8_t d16 = vreinterpretq_s16_u16(vmovl_u8(half ? vget_high_u8(d) : vget_low_u8(d)));
+			uint16x8_t r8 = vreinterpretq_u16_s16(vmovl_s8(vreinterpret_s8_u8(half ? vget_high_u8(isR) : vget_low_u8(isR))));
+			uint16x8_t g8 = vreinterpretq_u16_s16(vmovl_s8(vreinterpret_s8_u8(half ? vget_high_u8(isG) : vget_low_u8(isG))));
+			int16x8_t fromR = vsubq_s16(g16, b16);
+			int16x8_t fromG = vaddq_s16(vsubq_s16(b16, r16), vshlq_n_s16(d16, 1));
+			int16x8_t fromB = vaddq_s16(vsubq_s16(r16, g16), vshlq_n_s16(d16, 2));
+			int16x8_t h = vbslq_s16(r8, fromR, vbslq_s16(g8, fromG, fromB));
+			vst1q_s16(hue + i + half * 8, h);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		int v = max(max(b[i], g[i]), r[i]);
+		int d = v - min(min(b[i], g[i]), r[i]);
+		value[i] = v;
+		diff[i] = d;
+		if (v == r[i]) {
+			hue[i] = g[i] - b[i];
+		} else if (v == g[i]) {
+			hue[i] = b[i] - r[i] + 2 * d;
+		} else {
+			hue[i] = r[i] - g[i] + 4 * d;
+		}
+	}
+}
+
+}
+
+int sampleHSV(const Mat& bgr, int offset, int step,
+		uchar* hues, uchar* sats, uchar* brights,
+		int& avgHue, int& avgSat, int& avgBright) {
+	uchar b[BLOCK], g[BLOCK], r[BLOCK], value[BLOCK], diff[BLOCK];
+	short hue[BLOCK];
+	int cols = sampleColumns(bgr.cols, offset, step);
+	int n = 0, hueSum = 0, satSum = 0, brightSum = 0;
+	for (int i = offset; i < bgr.rows; i += step) {
+		const uchar* row = bgr.ptr<uchar>(i) + offset * 3;
+		for (int start = 0; start < cols; start += BLOCK) {
+			int count = min(BLOCK, cols - start);
+			const uchar* pixel = row + start * step * 3;
+			for (int j = 0; j < count; j++, pixel += step * 3) {
+				b[j] = pixel[0];
+				g[j] = pixel[1];
+				r[j] = pixel[2];
+			}
+			extremes(b, g, r, count, value, diff, hue);
+			for (int j = 0; j < count; j++, n++) {
+				int s = (diff[j] * reciprocals.sat[value[j]] + HSV_ROUND) >> HSV_SHIFT;
+				int h = (hue[j] * reciprocals.hue[diff[j]] + HSV_ROUND) >> HSV_SHIFT;
+				h += h < 0 ? HUE_RANGE : 0;
+				hues[n] = h;
+				sats[n] = s;
+				brights[n] = value[j];
+				hueSum += h;
+				satSum += s;
+				brightSum += value[j];
+			}
+		}
+	}
+	if (n > 0) {
+		avgHue = hueSum / n;
+		avgSat = satSum / n;
+		avgBright = brightSum / n;
+	}
+	return n;
+}
+
+void compareSamples(const uchar* hues, const uchar* sats, const uchar* brights,
+		const uchar* earlierHues, const uchar* earlierSats, const uchar* earlierBrights,
+		int count, int delta, uchar* changed) {
+	int i = 0;
+#if defined(HSV_SSE2)
+	// A saturating difference both ways round is the absolute difference,
+	// and it is within delta when taking delta off leaves zero
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i limit = _mm_set1_epi8((char) delta);
+	for (; i + LANES <= count; i += LANES) {
+		const uchar* now[3] = {hues + i, sats + i, brights + i};
+		const uchar* then[3] = {earlierHues + i, earlierSats + i, earlierBrights + i};
+		__m128i over = zero;
+		for (int c = 0; c < 3; c++) {
+			__m128i a = _mm_loadu_si128((const __m128i*) now[c]);
+			__m128i b = _mm_loadu_si128((const __m128i*) then[c]);
+			__m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+			over = _mm_or_si128(over, _mm_subs_epu8(d, limit));
+		}
+		_mm_storeu_si128((__m128i*) (changed + i),
+				_mm_andnot_si128(_mm_cmpeq_epi8(over, zero), _mm_set1_epi8(-1)));
+	}
+#elif defined(HSV_NEON)
+	const uint8x16_t limit = vdupq_n_u8(delta);
+	for (; i + LANES <= count; i += LANES) {
+		uint8x16_t over = vorrq_u8(vorrq_u8(
+				vcgtq_u8(vabdq_u8(vld1q_u8(hues + i), vld1q_u8(earlierHues + i)), limit),
+				vcgtq_u8(vabdq_u8(vld1q_u8(sats + i), vld1q_u8(earlierSats + i)), limit)),
+				vcgtq_u8(vabdq_u8(vld1q_u8(brights + i), vld1q_u8(earlierBrights + i)), limit));
+		vst1q_u8(changed + i, over);
+	}
+#endif
+	for (; i < count; i++) {
+		changed[i] = abs(hues[i] - earlierHues[i]) > delta || abs(sats[i] - earlierSats[i]) > delta
+				|| abs(brights[i] - earlierBrights[i]) > delta ? 255 : 0;
+	}
+}
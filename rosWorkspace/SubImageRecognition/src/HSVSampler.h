@@ -0,0 +1,26 @@
+#ifndef _HSV_SAMPLER_H
+#define _HSV_SAMPLER_H
+
+#include <opencv2/core/core.hpp>
+
+// Converts every step'th pixel of a BGR frame, starting at offset along both
+// axes, to the same 8-bit HSV cvtColor(..., CV_BGR2HSV) gives, without
+// converting the pixels in between. The planes get one row of
+// sampleColumns() samples for every sampled image row. Returns how many
+// samples there were and sets their average hue, saturation and value.
+int sampleHSV(const cv::Mat& bgr, int offset, int step,
+		unsigned char* hues, unsigned char* sats, unsigned char* brights,
+		int& avgHue, int& avgSat, int& avgBright);
+
+// Set each of count bytes of changed to 0 where the sample's hue, saturation
+// and value are all within delta of the earlier ones, or else to 255
+void compareSamples(const unsigned char* hues, const unsigned char* sats,
+		const unsigned char* brights, const unsigned char* earlierHues,
+		const unsigned char* earlierSats, const unsigned char* earlierBrights,
+		int count, int delta, unsigned char* changed);
+
+inline int sampleColumns(int cols, int offset, int step) {
+	return cols > offset ? (cols - offset + step - 1) / step : 0;
+}
+
+#endif
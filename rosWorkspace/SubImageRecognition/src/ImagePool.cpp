@@ -0,0 +1,33 @@
+#include "ImagePool.h"
+
+using namespace cv;
+using namespace std;
+
+ImagePool::ImagePool(const string& encoding, int type):
+encoding(encoding)
+,type(type)
+{
+}
+
+// Hand out a message of the given size with image pointing at its pixels
+sensor_msgs::ImagePtr ImagePool::get(int rows, int cols, const std_msgs::Header& header, Mat& image) {
+	sensor_msgs::ImagePtr message;
+	for (unsigned int i = 0; i < messages.size() && !message; i++) {
+		if (messages[i].unique()) {
+			message = messages[i];
+		}
+	}
+	if (!message) {
+		message.reset(new sensor_msgs::Image());
+		message->encoding = encoding;
+		message->is_bigendian = 0;
+		messages.push_back(message);
+	}
+	message->header = header;
+	message->height = rows;
+	message->width = cols;
+	message->step = cols * CV_ELEM_SIZE(type);
+	message->data.resize(rows * message->step);
+	image = Mat(rows, cols, type, message->data.empty() ? NULL : &message->data[0], message->step);
+	return message;
+}
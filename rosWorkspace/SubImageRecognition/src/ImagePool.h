@@ -0,0 +1,24 @@
+#ifndef _IMAGE_POOL_H
+#define _IMAGE_POOL_H
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/Image.h>
+
+// Image messages that are drawn into in place through a cv::Mat header and
+// then published as they are. A message is only handed out again once every
+// subscriber has let go of it, so once as many are made as are ever in
+// flight at once, frames go out without allocating or copying.
+class ImagePool {
+public:
+	ImagePool(const std::string& encoding, int type);
+	sensor_msgs::ImagePtr get(int rows, int cols, const std_msgs::Header& header, cv::Mat& image);
+
+private:
+	std::string encoding;
+	int type;
+	std::vector<sensor_msgs::ImagePtr> messages;
+};
+
+#endif
@@ -1,17 +1,19 @@
 #define _USE_MATH_DEFINES
 
 #include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <cv_bridge/cv_bridge.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <image_transport/image_transport.h>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <ros/ros.h>
 #include <sensor_msgs/image_encodings.h>
+#include <std_srvs/Empty.h>
 #include <stdio.h>
 #include <string.h>
 #include <vector>
-#include <fstream>
 #include <math.h>
-#include <sstream>
 
 #include "SubImageRecognition/ImgRecAlgorithm.h"
 #include "SubImageRecognition/ImgRecObject.h"
@@ -19,607 +21,710 @@
 #include "SubImageRecognition/ListAlgorithms.h"
 #include "SubImageRecognition/UpdateAlgorithm.h"
 #include "SubImageRecognition/SwitchAlgorithm.h"
-#include "DLT.h"
+#include "ImagePool.h"
+#include "LatencyHistogram.h"
+#include "Recognition.h"
+#include "StereoRange.h"
 
 using namespace cv;
 using namespace std;
 
 // CONSTANTS
 
-const int SAMPLE_SIZE = 4;
-const unsigned int MIN_POINTS = 200;
-const unsigned int MIN_POINTS_PATH = 400;
-const float MIN_CONFIDENCE = 0.5;
-const float MIN_PATH_CONFIDENCE = 0.7;
-
 const char NAMESPACE_ROOT[] = "img_rec/";
+const char TREE_DIRECTORY[] = "/opt/robosub/rosWorkspace/SubImageRecognition";
+const char BUNDLE_DEFAULT[] = "/opt/robosub/rosWorkspace/SubImageRecognition/classifiers.bundle";
+
+// The flags an ImgRecAlgorithm can set
+const int ALGORITHM_FLAGS = FLAG_ENABLED | FLAG_PUBLISH_THRESHOLD;
+// Between an object's name and one of CLASSIFIER_NAMES to switch it to
+const char CLASSIFIER_SEPARATOR = ':';
+
+// Each camera keeps a latency probe for every pipeline stage, then these
+const int PROBE_PUBLISH = STAGE_COUNT;
+const int PROBE_FRAME = STAGE_COUNT + 1;
+const int PROBE_LATENCY = STAGE_COUNT + 2;
+const int PROBE_ANNOTATE = STAGE_COUNT + 3;
+const int PROBE_STEREO = STAGE_COUNT + 4;
+const int CAMERA_PROBES = STAGE_COUNT + 5;
+
+const double DIAGNOSTICS_PERIOD_DEFAULT = 5.0;
+
+// With ~adaptive, a camera whose median camera to result latency over
+// ADAPT_FRAMES frames is over ~latency_budget first searches only around its
+// tracks, then samples ever more sparsely up to MAX_SAMPLE_SIZE. It steps
+// back once the median is under half the budget.
+const double LATENCY_BUDGET_DEFAULT = 0.2;
+const unsigned int ADAPT_FRAMES = 30;
+const int MAX_SAMPLE_SIZE = 16;
+
+// With ~stereo_baseline set, forward camera detections are ranged against
+// the left camera's frame if it was taken within STEREO_MAX_SKEW seconds
+const double STEREO_MAX_SKEW = 0.05;
+const int STEREO_MAX_DISPARITY_DEFAULT = 64;
+
+// GLOBALS
+
+// Indexed like objects
+vector<ros::Publisher> objectPublishers;
+ros::Publisher pizzaPublisher;
+bool adaptive = false;
+bool coherent = false;
+double stereoFocalLength = 0;
+double stereoBaseline = 0;
+int stereoMaxDisparity = STEREO_MAX_DISPARITY_DEFAULT;
+double latencyBudget = LATENCY_BUDGET_DEFAULT;
 
-const int FLAG_ENABLED = 1;
-const int FLAG_PUBLISH_THRESHOLD = 2;
-
-const int CAMERA_FORWARD = 0;
-const int CAMERA_DOWNWARD = 1;
-
-const int ANALYSIS_RECTANGLE = 0;
-
-const int CONFIDENCE_RECTANGLE = 0;
-const int CONFIDENCE_CIRCLE = 1;
-
-const int ANNOTATION_ROTATION = 0;
-const int ANNOTATION_RADIUS = 1;
-
-const int FRAME_MARGIN_OF_ERROR=3;
-const int TRACKING_MOVEMENT_TOLERANCE=200000;
+// FUNCTIONS
 
-// DEFINITIONS
+ros::Publisher advertiseObject(ros::NodeHandle& nodeHandle, const Object& object) {
+	string topic(NAMESPACE_ROOT);
+	topic += object.name;
+	return nodeHandle.advertise<SubImageRecognition::ImgRecObject>(topic, 1);
+}
 
-typedef vector<Point> Points;
+// CAMERAS
 
-class Object {
+// Runs one camera's frames through its pipeline and publishes what comes
+// out. Each camera processes frames on its own worker thread and fans the
+// per-object work out to the shared pool, so a backlog on one camera never
+// holds up the other. Detections go out as soon as they are found; the
+// annotated frame is drawn and published afterwards on a thread of its own,
+// and only while something subscribes to it.
+class Camera {
 public:
+	Camera(int id, image_transport::ImageTransport& imageTransport,
+			const string& annotatedTopic, const string& thresholdTopic);
+	void callback(const sensor_msgs::ImageConstPtr& rosImage);
+	// Frames from the left of the stereo pair, for the forward camera
+	void leftCallback(const sensor_msgs::ImageConstPtr& rosImage);
+	void stop();
+	void report(diagnostic_msgs::DiagnosticStatus& status);
+	void dump() const;
+
+private:
+	void work();
+	void process(const sensor_msgs::ImageConstPtr& rosImage);
+	void annotate();
+	void measureRanges(const sensor_msgs::ImageConstPtr& rosImage, const Mat& right);
+	void publishThreshold(const std_msgs::Header& header, const Size& size);
+	void record(double publishSeconds, double frameSeconds);
+	void adapt(double latency);
+
+	int id;
 	string name;
-	int flags;
-	int camera;
-	int analysisType;
-	int maxBlobs;
-	int confidenceType;
-	Scalar annotationColor;
-	int annotationType;
-	int enumType;
-	ros::Publisher publisher;
-	Object(string name, int flags, int camera, int analysisType, int maxBlobs, int confidenceType, Scalar annotationColor, int annotationType, int enumType):
-	name(name)
-	,flags(flags)
-	,camera(camera)
-	,analysisType(analysisType)
-	,maxBlobs(maxBlobs)
-	,confidenceType(confidenceType)
-	,annotationColor(annotationColor)
-	,annotationType(annotationType)
-	,enumType(enumType)
-	{
-		ros::NodeHandle nodeHandle;
-		string topic(NAMESPACE_ROOT);
-		topic += name;
-		publisher = nodeHandle.advertise<SubImageRecognition::ImgRecObject>(topic, 1);
-	};
+	image_transport::Publisher publisher;
+	image_transport::Publisher threshPublisher;
+	// Frames are rotated and annotated straight into the messages they are
+	// published in
+	ImagePool annotatedImages;
+	ImagePool thresholdImages;
+	FramePipeline pipeline;
+	vector<Detection> detections;
+	// Metres to each detection, or 0 where it isn't known
+	vector<float> ranges;
+	StereoRange stereo;
+	boost::mutex leftMutex;
+	sensor_msgs::ImageConstPtr left;
+
+	// Latency probes: the whole frame stages, then classify, blobs and
+	// analyse for each of this camera's objects, starting at objectProbes
+	vector<string> probeNames;
+	vector<LatencyHistogram> probes;
+	vector<int> objectProbes;
+	// What the last report had seen, so each one covers only its own period
+	vector<vector<unsigned long> > reported;
+	ros::WallTime lastReport;
+	// Camera to result latencies since the camera last adapted
+	vector<double> recentLatencies;
+
+	// Guards the frame counts and pipeline settings as well as pending.
+	// Frames are dropped when the subscriber queue skips one (a gap in
+	// header.seq) or when a newer one replaces one still waiting here.
+	boost::mutex mutex;
+	unsigned long received;
+	unsigned long processed;
+	unsigned long dropped;
+	// Samples that kept their cached labels with coherence, and all samples
+	// looked up, in all and as of the last report
+	unsigned long cacheHits;
+	unsigned long cacheLookups;
+	unsigned long reportedHits;
+	unsigned long reportedLookups;
+	unsigned int lastSeq;
+	boost::condition_variable arrived;
+	sensor_msgs::ImageConstPtr pending;
+	bool stopping;
+	boost::thread worker;
+
+	// The frame waiting to be annotated and what was found in it. Like
+	// pending, it is replaced if a newer frame is ready first. stopping is
+	// set under this as well.
+	boost::mutex annotateMutex;
+	boost::condition_variable annotateArrived;
+	sensor_msgs::ImagePtr annotatePending;
+	vector<Detection> annotateDetections;
+	boost::thread annotator;
 };
 
-class BlobAnalysis {
-public:
-		int center_x;
-		int center_y;
-		float rotation;
-		unsigned int width;
-		unsigned int height;
-		unsigned int size;
-
-		BlobAnalysis() {}
-
-		// Constructor for use with ANALYSIS_RECTANGLE
-		BlobAnalysis(Points& blob, RotatedRect rectangle) {
-				center_x = (int) rectangle.center.x;
-				center_y = (int) rectangle.center.y;
-				rotation = rectangle.angle;
-				width = (unsigned int) rectangle.size.width;
-				height = (unsigned int) rectangle.size.height;
-				size = blob.size();
-
-				// Convert rotation from degrees to radians
-				rotation *= M_PI / 180.0;
-
-				// Correct dimensions and rotation so that height is always larger
-				if (height < width) {
-						unsigned int temp = height;
-						height = width;
-						width = temp;
-				} else {
-						rotation -= M_PI / 2.0;
-				}
-		}
-};
-
-class BlobTrack
+Camera::Camera(int id, image_transport::ImageTransport& imageTransport,
+		const string& annotatedTopic, const string& thresholdTopic):
+id(id)
+,name(id == CAMERA_DOWNWARD ? "downward" : "forward")
+,annotatedImages(sensor_msgs::image_encodings::BGR8, CV_8UC3)
+,thresholdImages(sensor_msgs::image_encodings::MONO8, CV_8UC1)
+,pipeline(id)
+,stereo(stereoFocalLength, stereoBaseline, stereoMaxDisparity)
+,received(0)
+,processed(0)
+,dropped(0)
+,cacheHits(0)
+,cacheLookups(0)
+,reportedHits(0)
+,reportedLookups(0)
+,lastSeq(0)
+,stopping(false)
 {
-public:
-	int x;
-	int y;
-	int lifetime;
-	int lastSeen;
-	int objType;
-	BlobTrack(int x, int y, int lastSeen, int objType):
-	x(x)
-	,y(y)
-	,lastSeen(lastSeen)
-	,objType(objType)
-	,lifetime(0)
-	{
+	publisher = imageTransport.advertise(annotatedTopic, 1);
+	threshPublisher = imageTransport.advertise(thresholdTopic, 1);
+
+	probeNames.assign(STAGE_NAMES, STAGE_NAMES + STAGE_COUNT);
+	probeNames.push_back("publish");
+	probeNames.push_back("frame");
+	probeNames.push_back("latency");
+	probeNames.push_back("annotate");
+	probeNames.push_back("stereo");
+	objectProbes.assign(objects.size(), -1);
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		if (objects[i].camera == id) {
+			objectProbes[i] = probeNames.size();
+			for (int stage = STAGE_CLASSIFY; stage <= STAGE_ANALYSE; stage++) {
+				probeNames.push_back(string(STAGE_NAMES[stage]) + " " + objects[i].name);
+			}
+		}
 	}
-};
-
-// GLOBALS  :/  HA HA AH WELL
-
-vector<Object> objects;
-vector<BlobTrack> trackBlobs;
-vector<bool> objectTracking;
-vector<DLT> trees;
-
-int curFrame=0;
-
-int forwardOffset = 0, downwardOffset = 0;
-image_transport::Publisher forwardPublisher, downwardPublisher, forwardThresh, downwardThresh;
-cv_bridge::CvImage forwardRotated, downwardRotated;
-Mat forwardSegmented, downwardSegmented;
-Mat forwardThreshold, downwardThreshold;
-int lastAvgHue=0, lastAvgSat=0, lastAvgBright=0;
-bool pizzaCheck=false;
-Object* pizzaObj;	
-
-
-// FUNCTIONS
+	probes.resize(probeNames.size());
+	reported.resize(probeNames.size(), vector<unsigned long>(LatencyHistogram::BUCKETS));
+	lastReport = ros::WallTime::now();
+	recentLatencies.reserve(ADAPT_FRAMES);
+	pipeline.setCoherent(coherent);
+
+	worker = boost::thread(boost::bind(&Camera::work, this));
+	annotator = boost::thread(boost::bind(&Camera::annotate, this));
+}
 
-//Need to add enumTypes to Objects
-void initObjects() {
-		objects.push_back(Object(
-				"gate",
-				1,
-				CAMERA_FORWARD,
-				ANALYSIS_RECTANGLE,
-				2,
-				CONFIDENCE_RECTANGLE,
-				Scalar(0, 128, 255), // Orange
-				ANNOTATION_ROTATION,
-				1
-		));
-		objectTracking.push_back(true);
-
-		objects.push_back(Object(
-				"buoys/red",
-                1,
-				CAMERA_FORWARD,
-				ANALYSIS_RECTANGLE,
-				1,
-				CONFIDENCE_CIRCLE,
-				Scalar(0, 0, 255), // Red
-				ANNOTATION_RADIUS,
-				2
-		));
-		objectTracking.push_back(true);
-		// objects.push_back(Object(
-		// 		"buoys/green",
-  //               1,
-		// 		CAMERA_FORWARD,
-		// 		ANALYSIS_RECTANGLE,
-		// 		1,
-		// 		CONFIDENCE_CIRCLE,
-		// 		Scalar(0, 255, 0), // Green
-		// 		ANNOTATION_RADIUS,
-		// 		3
-		// ));
-		// objects.push_back(Object(
-		// 		"buoys/yellow",
-  //               1,
-		// 		CAMERA_FORWARD,
-		// 		ANALYSIS_RECTANGLE,
-		// 		1,
-		// 		CONFIDENCE_CIRCLE,
-		// 		Scalar(0, 255, 255), // Yellow
-		// 		ANNOTATION_RADIUS,
-		// 		4
-		// ));
-		objects.push_back(Object(
-				"paths",
-                1,
-				CAMERA_DOWNWARD,
-				ANALYSIS_RECTANGLE,
-				2,
-				CONFIDENCE_RECTANGLE,
-				Scalar(0, 128, 255), // Orange
-				ANNOTATION_ROTATION,
-				3
-		));
-		objectTracking.push_back(true);
-		objects.push_back(Object(
-				"parking",
-                1,
-				CAMERA_FORWARD,
-				ANALYSIS_RECTANGLE,
-				3,
-				CONFIDENCE_RECTANGLE,
-				Scalar(255, 0, 0), // Blue
-				ANNOTATION_ROTATION,
-				4
-		));
-		objectTracking.push_back(true);
-		// objects.push_back(Object(
-		// 		"red led buoy",
-  //               1,
-		// 		CAMERA_FORWARD,
-		// 		ANALYSIS_RECTANGLE,
-		// 		1,
-		// 		CONFIDENCE_RECTANGLE,
-		// 		Scalar(255, 0, 0), // Blue
-		// 		ANNOTATION_ROTATION,
-		// 		7
-		// ));
-
-
-        pizzaObj=new Object(
-					"pizza_box",
-	                1,
-					CAMERA_FORWARD,
-					ANALYSIS_RECTANGLE,
-					2,
-					CONFIDENCE_RECTANGLE,
-					Scalar(0, 255, 255),
-					ANNOTATION_ROTATION,
-					255
-				);
-        objectTracking.push_back(false);
+// Runs on the ROS spin thread, so only hand the frame over to the worker. A
+// frame the worker hasn't started on yet is replaced by the newer one.
+void Camera::callback(const sensor_msgs::ImageConstPtr& rosImage) {
+	boost::lock_guard<boost::mutex> lock(mutex);
+	unsigned int seq = rosImage->header.seq;
+	if (received > 0 && seq > lastSeq + 1) {
+		dropped += seq - lastSeq - 1;
+	}
+	lastSeq = seq;
+	received++;
+	if (pending) {
+		dropped++;
+	}
+	pending = rosImage;
+	arrived.notify_one();
+}
 
+void Camera::leftCallback(const sensor_msgs::ImageConstPtr& rosImage) {
+	boost::lock_guard<boost::mutex> lock(leftMutex);
+	left = rosImage;
 }
 
-/*void normalizeValue(Mat& image, Mat& temp) {
-		const static int valueOut[] = {2, 0};
-		const static int valueIn[] = {0, 2};
-		temp.create(image.rows, image.cols, CV_8UC1);
-		mixChannels(&image, 1, &temp, 1, valueOut, 1);
-		normalize(temp, temp, 0, 255, CV_MINMAX);
-		mixChannels(&temp, 1, &image, 1, valueIn, 1);
-}*/
-
-void reduceNoise(Mat& image) {
-		const static Size size(3, 3);
-		const static Point point(1, 1);
-		const static Mat elementRect = getStructuringElement(
-						MORPH_RECT, size, point);
-		erode(image, image, elementRect, point, 5);
-		dilate(image, image, elementRect, point, 2);
+void Camera::stop() {
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		boost::lock_guard<boost::mutex> annotateLock(annotateMutex);
+		stopping = true;
+	}
+	arrived.notify_one();
+	annotateArrived.notify_one();
+	worker.join();
+	annotator.join();
 }
 
-Points findBlob(Mat& image, int i, int j, int obj) {
-		unsigned int index = 0;
-		Points blob;
-		Point point(j, i);
-		blob.push_back(point);
-		int doneThresh = (obj==1||obj==3) ? 255 : 0;
-		image.at<uint8_t>(i, j, 0)=doneThresh;
-		while (index < blob.size()) {
-				point = blob[index];
-				i = point.y;
-				j = point.x;
-				if (i+SAMPLE_SIZE < image.rows
-								&& image.at<uint8_t>(i+SAMPLE_SIZE, j, 0) == obj) {
-						blob.push_back(Point(j, i+SAMPLE_SIZE));
-						image.at<uint8_t>(i+SAMPLE_SIZE, j, 0)=doneThresh;
-				}
-				if (i-SAMPLE_SIZE >= 0
-								&& image.at<uint8_t>(i-SAMPLE_SIZE, j, 0) == obj) {
-						blob.push_back(Point(j, i-SAMPLE_SIZE));
-						image.at<uint8_t>(i-SAMPLE_SIZE, j, 0)=doneThresh;
-				}
-				if (j+SAMPLE_SIZE < image.cols
-								&& image.at<uint8_t>(i, j+SAMPLE_SIZE, 0) == obj) {
-						blob.push_back(Point(j+SAMPLE_SIZE, i));
-						image.at<uint8_t>(i, j+SAMPLE_SIZE, 0)=doneThresh;
-				}
-				if (j-SAMPLE_SIZE >= 0 &&
-								image.at<uint8_t>(i, j-SAMPLE_SIZE, 0) == obj) {
-						blob.push_back(Point(j-SAMPLE_SIZE, i));
-						image.at<uint8_t>(i, j-SAMPLE_SIZE, 0)=doneThresh;
-				}
-				index++;
+void Camera::work() {
+	while (true) {
+		sensor_msgs::ImageConstPtr rosImage;
+		{
+			boost::unique_lock<boost::mutex> lock(mutex);
+			while (!pending && !stopping) {
+				arrived.wait(lock);
+			}
+			if (stopping) {
+				return;
+			}
+			rosImage.swap(pending);
+			processed++;
 		}
-		return blob;
+		process(rosImage);
+	}
 }
 
-bool compareBlobs(Points& blob0, Points& blob1) {
-		return blob0.size() < blob1.size();
+// One threshold image with every active object's full resolution search
+// windows in it, made only while something is listening
+void Camera::publishThreshold(const std_msgs::Header& header, const Size& size) {
+	if (pipeline.activeObjects().empty() || threshPublisher.getNumSubscribers() == 0) {
+		return;
+	}
+	Mat combined;
+	sensor_msgs::ImagePtr message = thresholdImages.get(size.height, size.width, header, combined);
+	pipeline.drawThresholds(combined);
+	threshPublisher.publish(message);
 }
 
-vector<Points> findBlobs(Mat& image,
-				const int offset, const unsigned int maxBlobs, int obj) {
-		// First get all blobs that are at least the minimum size
-		vector<Points> allBlobs;
-		for (int i = offset; i < image.rows; i += SAMPLE_SIZE) {
-				for (int j = offset; j < image.cols; j += SAMPLE_SIZE) {
-						if (image.at<uint8_t>(i, j, 0) == obj) {
-								Points blob = findBlob(image, i, j, obj);
-								if (blob.size() >= ((obj==3) ? MIN_POINTS_PATH : MIN_POINTS)) {
-										allBlobs.push_back(blob);
-								}
-						}
-				}
-		}
-		// Stop now if there are 'maxBlobs' or fewer blobs
-		if (allBlobs.size() <= maxBlobs) {
-				return allBlobs;
-		}
-		// Otherwise limit to the biggest 'maxBlobs' blobs
-		make_heap(allBlobs.begin(), allBlobs.end(), compareBlobs);
-		vector<Points> blobs = vector<Points>();
-		blobs.push_back(allBlobs.front());
-		for (unsigned int i = 1; i < maxBlobs && allBlobs.size() > 1; i++) {
-				pop_heap(allBlobs.begin(), allBlobs.end(), compareBlobs);
-				blobs.push_back(allBlobs.front());
+void Camera::record(double publishSeconds, double frameSeconds) {
+	const double* seconds = pipeline.stageSeconds();
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		probes[stage].record(seconds[stage]);
+	}
+	probes[PROBE_PUBLISH].record(publishSeconds);
+	probes[PROBE_FRAME].record(frameSeconds);
+	const vector<int>& active = pipeline.activeObjects();
+	for (unsigned int a = 0; a < active.size(); a++) {
+		const vector<double>& objectSeconds = pipeline.objectStageSeconds(active[a]);
+		for (int stage = STAGE_CLASSIFY; stage <= STAGE_ANALYSE; stage++) {
+			probes[objectProbes[active[a]] + stage - STAGE_CLASSIFY].record(objectSeconds[stage]);
 		}
-		return blobs;
+	}
 }
 
-vector<BlobAnalysis> analyzeBlob(Object& object,
-				Points& blob, Mat& image) {
-		vector<BlobAnalysis> analysisList;
-		RotatedRect rectangle;
-		switch (object.analysisType) {
-		case ANALYSIS_RECTANGLE:
-				analysisList.push_back(BlobAnalysis(blob, minAreaRect(Mat(blob))));
-				break;
+// Percentiles of each probe since the last report, for the diagnostics topic
+void Camera::report(diagnostic_msgs::DiagnosticStatus& status) {
+	ros::WallTime now = ros::WallTime::now();
+	double period = (now - lastReport).toSec();
+	lastReport = now;
+
+	status.level = diagnostic_msgs::DiagnosticStatus::OK;
+	status.name = "ImageRecognition: " + name + " camera";
+	status.hardware_id = name + "_camera";
+	status.values.clear();
+	unsigned long frames = 0;
+	double latency = 0;
+	vector<unsigned long> counts;
+	for (unsigned int i = 0; i < probes.size(); i++) {
+		probes[i].snapshot(counts);
+		for (int bucket = 0; bucket < LatencyHistogram::BUCKETS; bucket++) {
+			unsigned long seen = counts[bucket];
+			counts[bucket] -= reported[i][bucket];
+			reported[i][bucket] = seen;
 		}
-		return analysisList;
-}
-
-float computeConfidence(Object& object, BlobAnalysis& a) {
-		// A return value of -1 indicates 'divide by zero' error
-		// A return value of -2 indicates 'unknown confidence type' error
-		int expectedPoints;
-		switch (object.confidenceType) {
-		case CONFIDENCE_RECTANGLE:
-				expectedPoints = (a.width * a.height) / (SAMPLE_SIZE * SAMPLE_SIZE);
-				break;
-		case CONFIDENCE_CIRCLE:
-				expectedPoints =
-								(M_PI * a.width * a.height) / (4 * SAMPLE_SIZE * SAMPLE_SIZE);
-				break;
-		default:
-				return -2; // Unknown confidence type
+		unsigned long total = LatencyHistogram::total(counts);
+		if (i == PROBE_FRAME) {
+			frames = total;
 		}
-		if (expectedPoints <= 0) {
-				return -1; // Divide by zero
-		} else {
-				float confidence = ((float) a.size) / ((float) expectedPoints);
-				if (confidence > 1) {
-						return 1;
-				} else {
-						return confidence;
-				}
+		if (i == PROBE_LATENCY) {
+			latency = LatencyHistogram::percentile(counts, 0.5);
+		}
+		if (total == 0) {
+			continue;
 		}
+		char text[128];
+		snprintf(text, sizeof(text), "p50 %.3f  p90 %.3f  p99 %.3f  max %.3f  (%lu)",
+				LatencyHistogram::percentile(counts, 0.5) * 1000,
+				LatencyHistogram::percentile(counts, 0.9) * 1000,
+				LatencyHistogram::percentile(counts, 0.99) * 1000,
+				LatencyHistogram::percentile(counts, 1) * 1000, total);
+		diagnostic_msgs::KeyValue value;
+		value.key = probeNames[i] + " ms";
+		value.value = text;
+		status.values.push_back(value);
+	}
+
+	boost::lock_guard<boost::mutex> lock(mutex);
+	char text[64];
+	const char* names[] = {"frames received", "frames processed", "frames dropped", "sample step"};
+	unsigned long values[] = {received, processed, dropped, (unsigned long) pipeline.sampleStep()};
+	for (int i = 0; i < 4; i++) {
+		diagnostic_msgs::KeyValue value;
+		value.key = names[i];
+		snprintf(text, sizeof(text), "%lu", values[i]);
+		value.value = text;
+		status.values.push_back(value);
+	}
+	diagnostic_msgs::KeyValue value;
+	value.key = "roi tracking";
+	value.value = pipeline.isRoiTracking() ? "forced" : "by object";
+	status.values.push_back(value);
+	if (pipeline.isCoherent()) {
+		unsigned long hits = cacheHits - reportedHits;
+		unsigned long lookups = cacheLookups - reportedLookups;
+		reportedHits = cacheHits;
+		reportedLookups = cacheLookups;
+		value.key = "classification cache hit rate";
+		snprintf(text, sizeof(text), "%.1f%% of %lu samples", lookups ? 100.0 * hits / lookups : 0, lookups);
+		value.value = text;
+		status.values.push_back(value);
+	}
+
+	if (latency > latencyBudget) {
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+	}
+	snprintf(text, sizeof(text), "%.1f frames/s, %lu dropped in all", period > 0 ? frames / period : 0, dropped);
+	status.message = text;
 }
 
-void annotateImage(Mat& image, Object& object, BlobAnalysis& a, float confidence) {
-		int r, x, y;
-		stringstream text;
-		text<<"Confidence: "<<confidence;
-		switch (object.annotationType) {
-		case ANNOTATION_ROTATION:
-				x = (int) (a.height / 2.0 * cos(a.rotation));
-				y = (int) (a.height / 2.0 * sin(a.rotation));
-				circle(image, Point(a.center_x, a.center_y), 1,
-								object.annotationColor, 5, CV_AA);
-				line(image, Point(a.center_x, a.center_y),
-								Point(a.center_x + x, a.center_y + y),
-								object.annotationColor, 1, CV_AA);
-				break;
-		case ANNOTATION_RADIUS:
-				r = (int) ((a.width + a.height) / 4.0);
-				circle(image, Point(a.center_x, a.center_y), r,
-								object.annotationColor, 2, CV_AA);
-				break;
+// Every probe's whole histogram since the node started, to the log
+void Camera::dump() const {
+	vector<unsigned long> counts;
+	for (unsigned int i = 0; i < probes.size(); i++) {
+		probes[i].snapshot(counts);
+		string line;
+		for (int bucket = 0; bucket < LatencyHistogram::BUCKETS; bucket++) {
+			if (counts[bucket] > 0) {
+				char text[48];
+				snprintf(text, sizeof(text), " <=%.3f:%lu", LatencyHistogram::bucketLimit(bucket) * 1000, counts[bucket]);
+				line += text;
+			}
 		}
-		putText(image, text.str(), Point(a.center_x +5, a.center_y+5), 1, 3, Scalar(255, 255, 255));
+		ROS_INFO("%s camera %s ms (%lu):%s", name.c_str(), probeNames[i].c_str(),
+				LatencyHistogram::total(counts), line.c_str());
+	}
 }
 
+void Camera::process(const sensor_msgs::ImageConstPtr& rosImage) {
+		double start = ros::WallTime::now().toSec();
 
-//assuming i=y and j=x
-void objInRange(const Mat& segmented, Mat& threshold, const int offset, int index)
-{	//cout<<"Threshing\n";
-	int count=0, hue=0, sat=0, bright=0;
-	if (threshold.total() == 0) {
-		threshold.create(segmented.rows, segmented.cols, CV_8U);
-	}
-	for (int i = offset; i < threshold.rows; i += SAMPLE_SIZE) {
-		for (int j = offset; j < threshold.cols; j += SAMPLE_SIZE) {
-			Sample sample;
-			Vec3b hsv = segmented.at<cv::Vec3b>(i, j);
-			sample.type=0;
-			//sample.iAttr[0]=lastAvgHue;
-			sample.iAttr[0]=lastAvgSat;
-			sample.iAttr[1]=lastAvgBright;
-			sample.iAttr[2]=hsv[0];
-			sample.iAttr[3]=hsv[1];
-			sample.iAttr[4]=hsv[2];
-			hue+=hsv[0];
-			sat+=hsv[1];
-			bright+=hsv[2];
-			++count;
-			int temp=trees[index].Classify(sample);
-			threshold.at<uint8_t>(i,j,0)=(temp ? (temp*10+200) : 0);
-			// if(temp && i<threshold.rows-SAMPLE_SIZE && j<threshold.cols-SAMPLE_SIZE)
-			// {
-   //              rectangle(threshold, Rect(j,i,SAMPLE_SIZE, SAMPLE_SIZE), (temp*10+200)); 
-			// }
+		// Share the ROS image's pixels in OpenCV format
+		cv_bridge::CvImageConstPtr cvImage = cv_bridge::toCvShare(rosImage, "bgr8");
+		const Mat& raw = cvImage->image;
+
+		// Work on the frame in the message it will be annotated and
+		// published in
+		Size upright = pipeline.uprightSize(raw);
+		Mat image;
+		sensor_msgs::ImagePtr annotated = annotatedImages.get(upright.height, upright.width,
+				rosImage->header, image);
+		pipeline.process(raw, image, detections);
+		if (pipeline.isCoherent()) {
+			boost::lock_guard<boost::mutex> lock(mutex);
+			cacheHits += pipeline.cacheHits();
+			cacheLookups += pipeline.cacheLookups();
+		}
+		measureRanges(rosImage, raw);
+		double detected = ros::WallTime::now().toSec();
+
+		ros::Time time = ros::Time::now();
+		for (unsigned int i = 0; i < detections.size(); i++) {
+				Detection& detection = detections[i];
+				BlobAnalysis& analysis = detection.analysis;
+				SubImageRecognition::ImgRecObject msg;
+				msg.stamp = time;
+				msg.id = detection.id;
+				msg.center_x = analysis.center_x - image.cols / 2;
+				msg.center_y = image.rows / 2 - analysis.center_y;
+				msg.rotation = (analysis.rotation + M_PI / 2.0) * 180.0 / M_PI;
+				msg.width = analysis.width;
+				msg.height = analysis.height;
+				msg.confidence = detection.confidence;
+				msg.range = ranges[i];
+				objectPublishers[detection.object].publish(msg);
+		}
+		double published = ros::WallTime::now().toSec();
+		// Camera to result latency ends once the detections are out
+		ros::Duration latency = ros::Time::now() - rosImage->header.stamp;
+
+		publishThreshold(rosImage->header, upright);
+		if (publisher.getNumSubscribers() > 0) {
+			boost::lock_guard<boost::mutex> lock(annotateMutex);
+			annotatePending = annotated;
+			annotateDetections = detections;
+			annotateArrived.notify_one();
+		}
+		double finished = ros::WallTime::now().toSec();
+		record(published - detected, finished - start);
+		if (!rosImage->header.stamp.isZero()) {
+			probes[PROBE_LATENCY].record(latency.toSec());
+			if (adaptive) {
+				adapt(latency.toSec());
+			}
 		}
-	}
-	lastAvgHue=hue/count;
-	lastAvgSat=sat/count;
-	lastAvgBright=bright/count;
 }
 
-bool inCircle(BlobAnalysis analysis, BlobTrack track)
-{
-	int deltaX=analysis.center_x-track.x;
-	int deltaY=analysis.center_y-track.y;
-	return (sqrt((float)deltaX * deltaX + deltaY * deltaY)) <= TRACKING_MOVEMENT_TOLERANCE;
+// Range every detection against the left frame nearest in time, if there is
+// one close enough
+void Camera::measureRanges(const sensor_msgs::ImageConstPtr& rosImage, const Mat& right) {
+	ranges.assign(detections.size(), 0);
+	if (!stereo.isEnabled() || detections.empty()) {
+		return;
+	}
+	sensor_msgs::ImageConstPtr leftImage;
+	{
+		boost::lock_guard<boost::mutex> lock(leftMutex);
+		leftImage = left;
+	}
+	if (!leftImage || fabs((leftImage->header.stamp - rosImage->header.stamp).toSec()) > STEREO_MAX_SKEW) {
+		return;
+	}
+	double start = ros::WallTime::now().toSec();
+	cv_bridge::CvImageConstPtr cvLeft = cv_bridge::toCvShare(leftImage, "bgr8");
+	if (cvLeft->image.size() != right.size()) {
+		return;
+	}
+	for (unsigned int i = 0; i < detections.size(); i++) {
+		const BlobAnalysis& analysis = detections[i].analysis;
+		Rect box = RotatedRect(Point2f(analysis.center_x, analysis.center_y),
+				Size2f(analysis.width, analysis.height),
+				analysis.rotation * 180 / M_PI).boundingRect();
+		ranges[i] = stereo.range(right, cvLeft->image, box);
+	}
+	probes[PROBE_STEREO].record(ros::WallTime::now().toSec() - start);
 }
 
-bool trackBlob(BlobAnalysis analysis, int type)
-{
-	for(int i=0;i<trackBlobs.size();++i)
-	{
-		if(type==trackBlobs[i].objType)
+// Draws what was found onto frames and publishes them, on its own thread so
+// the next frame isn't held up
+void Camera::annotate() {
+	vector<Detection> found;
+	while (true) {
+		sensor_msgs::ImagePtr annotated;
 		{
-			if(inCircle(analysis, trackBlobs[i]))
-			{
-				trackBlobs[i].x=analysis.center_x;
-				trackBlobs[i].y=analysis.center_y;
-				trackBlobs[i].lastSeen=curFrame;
-				++trackBlobs[i].lifetime;
-				return FRAME_MARGIN_OF_ERROR<=trackBlobs[i].lifetime;
+			boost::unique_lock<boost::mutex> lock(annotateMutex);
+			while (!annotatePending && !stopping) {
+				annotateArrived.wait(lock);
 			}
+			if (stopping) {
+				return;
+			}
+			annotated.swap(annotatePending);
+			found.swap(annotateDetections);
+		}
+		double start = ros::WallTime::now().toSec();
+		Mat image(annotated->height, annotated->width, CV_8UC3, &annotated->data[0], annotated->step);
+		for (unsigned int i = 0; i < found.size(); i++) {
+			annotateImage(image, objects[found[i].object], found[i].analysis, found[i].confidence);
 		}
+		publisher.publish(annotated);
+		probes[PROBE_ANNOTATE].record(ros::WallTime::now().toSec() - start);
 	}
-	trackBlobs.push_back(BlobTrack(analysis.center_x, analysis.center_y, curFrame, type));
-	return false;
 }
 
-void updateBlobTracking()
-{
-	for(int i=0;i<trackBlobs.size();++i)
-	{
-		if(trackBlobs[i].lastSeen < (curFrame - FRAME_MARGIN_OF_ERROR))
-		{
-			trackBlobs.erase(trackBlobs.begin()+i);
-			--i;
+// Trade detail for speed while the camera can't keep within the latency
+// budget, and take it back once it comfortably can
+void Camera::adapt(double latency) {
+	recentLatencies.push_back(latency);
+	if (recentLatencies.size() < ADAPT_FRAMES) {
+		return;
+	}
+	nth_element(recentLatencies.begin(), recentLatencies.begin() + ADAPT_FRAMES / 2, recentLatencies.end());
+	double median = recentLatencies[ADAPT_FRAMES / 2];
+	recentLatencies.clear();
+
+	boost::lock_guard<boost::mutex> lock(mutex);
+	int step = pipeline.sampleStep();
+	if (median > latencyBudget) {
+		if (!pipeline.isRoiTracking()) {
+			pipeline.setRoiTracking(true);
+		} else if (step < MAX_SAMPLE_SIZE) {
+			pipeline.setSampleStep(step * 2);
+		} else {
+			return;
 		}
+	} else if (median < latencyBudget / 2) {
+		if (step > SAMPLE_SIZE) {
+			pipeline.setSampleStep(step / 2);
+		} else if (pipeline.isRoiTracking()) {
+			pipeline.setRoiTracking(false);
+		} else {
+			return;
+		}
+	} else {
+		return;
 	}
-	++curFrame;
+	ROS_WARN("%s camera median latency %.0f ms against a %.0f ms budget: sampling every %d pixels%s",
+			name.c_str(), median * 1000, latencyBudget * 1000, pipeline.sampleStep(),
+			pipeline.isRoiTracking() ? " around tracks" : "");
 }
 
-void genericCallback(
-				const int camera,
-				const sensor_msgs::ImageConstPtr& rosImage,
-				cv_bridge::CvImage& rotated,
-				Mat& segmented,
-				Mat& threshold,
-				const int offset,
-				const image_transport::Publisher& publisher,
-				const image_transport::Publisher& threshPublisher) {
-		// Copy image from ROS format to OpenCV format
-		cv_bridge::CvImageConstPtr cvImage = cv_bridge::toCvShare(rosImage, "bgr8");
+// DIAGNOSTICS
 
-		// Rotate image upright
-		//TODO: find a better way to stop forward camera rotation
-		if (camera == CAMERA_DOWNWARD) {
-	    	transpose(cvImage->image, rotated.image);
-		    flip(rotated.image, rotated.image, 0); // 0=ccw, 1=cw
-    		rotated.encoding = cvImage->encoding;
-		}
-		else{
-			rotated = *cvImage;
+vector<Camera*> cameras;
+ros::Publisher diagnosticsPublisher;
+
+void publishDiagnostics(const ros::WallTimerEvent& event) {
+	diagnostic_msgs::DiagnosticArray diagnostics;
+	diagnostics.header.stamp = ros::Time::now();
+	diagnostics.status.resize(cameras.size());
+	for (unsigned int i = 0; i < cameras.size(); i++) {
+		cameras[i]->report(diagnostics.status[i]);
+	}
+	diagnosticsPublisher.publish(diagnostics);
+}
+
+bool dumpLatency(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response) {
+	for (unsigned int i = 0; i < cameras.size(); i++) {
+		cameras[i]->dump();
+	}
+	return true;
+}
+
+// ALGORITHMS
+
+int findObject(const string& name) {
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		if (objects[i].name == name) {
+			return i;
 		}
+	}
+	return -1;
+}
 
-		// Segment into HSV
-		cvtColor(rotated.image, segmented, CV_BGR2HSV);
-
-		// Normalize brightness and copy back to BGR
-		//normalizeValue(segmented, threshold);
-		//cvtColor(segmented, rotated.image, CV_HSV2BGR);
-
-		// Iterate through all objects
-		for (unsigned int i = 0; i < objects.size(); i++) {
-			if(objectTracking[i])
-			{
-				Object object = objects[i];
-				objInRange(segmented, threshold, offset, i);
-				if (true) 
-				{
-					cv_bridge::CvImage temp;
-					temp.encoding = "mono8";
-					temp.image = threshold;
-					threshPublisher.publish(temp.toImageMsg());
-				}
-				// Run applicable algorithms
-				if ((object.flags & FLAG_ENABLED) && object.camera == camera) {
-						//reduceNoise(threshold);
-                        int tempenum=object.enumType;
-						vector<Points> blobs = findBlobs(
-										threshold, offset, object.maxBlobs, (tempenum ? (tempenum*10+200) : 0));
-						// Iterate through all blobs
-						for (unsigned int j = 0; j < blobs.size(); j++) {
-								vector<BlobAnalysis> analysisList =
-												analyzeBlob(object, blobs[j], rotated.image);
-								// Iterate through all blob analysis objects
-								ros::Time time = ros::Time::now();
-								for (unsigned int k = 0; k < analysisList.size(); k++) {
-										BlobAnalysis analysis = analysisList[k];
-                           
-                                        // if(true)
-										float tempConfidence=computeConfidence(object, analysis);
-										if(tempConfidence > ((object.enumType==3) ? MIN_PATH_CONFIDENCE : MIN_CONFIDENCE))
-										{
-											if(trackBlob(analysis, object.enumType)) 
-											{
-												// if(object.enumType==3)
-												//  	cout<<"Publishing blob: "<<object.enumType<<" size: "<<analysis.size<<" confidence: "<<tempConfidence<<endl;
-												SubImageRecognition::ImgRecObject msg;
-												msg.stamp = time;
-												msg.id = k;
-												msg.center_x = analysis.center_x - rotated.image.cols / 2;
-												msg.center_y = rotated.image.rows / 2 - analysis.center_y;
-												msg.rotation = (analysis.rotation + M_PI / 2.0) * 180.0 / M_PI;
-												msg.width = analysis.width;
-												msg.height = analysis.height;
-												msg.confidence = tempConfidence;
-												object.publisher.publish(msg);
-												// Annotate image
-												annotateImage(rotated.image, object, analysis, tempConfidence);
-								
-											}
-										}
-
-								}
-						}
-				}
-			}
+int findClassifier(const string& name) {
+	for (int i = 0; i < CLASSIFIER_COUNT; i++) {
+		if (name == CLASSIFIER_NAMES[i]) {
+			return i;
 		}
+	}
+	return -1;
+}
 
-		// Publish annotated image
-		publisher.publish(rotated.toImageMsg());
-		updateBlobTracking();
+bool listAlgorithms(SubImageRecognition::ListAlgorithms::Request& request,
+		SubImageRecognition::ListAlgorithms::Response& response) {
+	ClassifiersPtr classifiers = currentClassifiers();
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		const HSVRange& range = classifiers->ranges[i];
+		SubImageRecognition::ImgRecAlgorithm algorithm;
+		algorithm.name = objects[i].name;
+		algorithm.flags = classifiers->flags[i] & ALGORITHM_FLAGS;
+		algorithm.h_min = range.hMin;
+		algorithm.h_max = range.hMax;
+		algorithm.s_min = range.sMin;
+		algorithm.s_max = range.sMax;
+		algorithm.v_min = range.vMin;
+		algorithm.v_max = range.vMax;
+		response.algorithms.push_back(algorithm);
+	}
+	return true;
 }
 
-void forwardCallback(const sensor_msgs::ImageConstPtr& rosImage) {
-		genericCallback(CAMERA_FORWARD, rosImage, forwardRotated, forwardSegmented,
-						forwardThreshold, forwardOffset, forwardPublisher, forwardThresh);
-		forwardOffset = (forwardOffset + 1) % SAMPLE_SIZE;
+// Sets the object's flags along with its HSV bounds if any are given, or
+// else with its tree read again, in one swap. A tree retrained poolside takes
+// over from the next frame without losing any tracks.
+bool updateAlgorithm(SubImageRecognition::UpdateAlgorithm::Request& request,
+		SubImageRecognition::UpdateAlgorithm::Response& response) {
+	const SubImageRecognition::ImgRecAlgorithm& algorithm = request.algorithm;
+	int index = findObject(algorithm.name);
+	response.result = 0;
+	if (index < 0) {
+		ROS_WARN("No algorithm named %s", algorithm.name.c_str());
+		return true;
+	}
+	HSVRange range(algorithm.h_min, algorithm.h_max, algorithm.s_min, algorithm.s_max,
+			algorithm.v_min, algorithm.v_max);
+	if (range.isSet()) {
+		response.result = setClassifierRange(index, range, algorithm.flags, ALGORITHM_FLAGS);
+	} else if (reloadClassifier(index, algorithm.flags, ALGORITHM_FLAGS)) {
+		response.result = 1;
+	} else {
+		setObjectFlags(index, algorithm.flags, ALGORITHM_FLAGS);
+		ROS_WARN("Could not reload the tree for %s", algorithm.name.c_str());
+	}
+	return true;
 }
 
-void downwardCallback(const sensor_msgs::ImageConstPtr& rosImage) {
-		genericCallback(CAMERA_DOWNWARD, rosImage, downwardRotated, downwardSegmented,
-						downwardThreshold, downwardOffset, downwardPublisher, downwardThresh);
-		downwardOffset = (downwardOffset + 1) % SAMPLE_SIZE;
+// Given an object's name, turns it and its threshold on or off. Given an
+// object's name, CLASSIFIER_SEPARATOR and a classifier's name, such as
+// "gate:range", classifies the object that way from the next frame. Given
+// anything else, swaps in every tree from that bundle or tree directory.
+bool switchAlgorithm(SubImageRecognition::SwitchAlgorithm::Request& request,
+		SubImageRecognition::SwitchAlgorithm::Response& response) {
+	int index = findObject(request.name);
+	size_t separator = request.name.rfind(CLASSIFIER_SEPARATOR);
+	int classified = -1, classifier = -1;
+	if (separator != string::npos) {
+		classified = findObject(request.name.substr(0, separator));
+		classifier = findClassifier(request.name.substr(separator + 1));
+	}
+	if (classified >= 0 && classifier >= 0) {
+		if (classifier == CLASSIFIER_RANGE && !currentClassifiers()->ranges[classified].isSet()) {
+			ROS_WARN("%s has no HSV bounds to classify with", objects[classified].name.c_str());
+			response.result = 0;
+		} else {
+			response.result = setObjectClassifier(classified, classifier);
+		}
+	} else if (index >= 0) {
+		response.result = setObjectFlags(index, (request.enabled ? FLAG_ENABLED : 0)
+				| (request.publish_threshold ? FLAG_PUBLISH_THRESHOLD : 0), ALGORITHM_FLAGS);
+	} else if (loadClassifiers(request.name)) {
+		ROS_INFO("Switched to the classifiers in %s", request.name.c_str());
+		response.result = 1;
+	} else {
+		ROS_WARN("Could not load classifiers from %s", request.name.c_str());
+		response.result = 0;
+	}
+	return true;
 }
 
 int main(int argc, char **argv) {
-	fstream file;
-	file.open("/opt/robosub/rosWorkspace/SubImageRecognition/gate.tree");
-	trees.push_back(DLT(file));
-	file.close();
-	file.open("/opt/robosub/rosWorkspace/SubImageRecognition/redbuoy.tree");
-	trees.push_back(DLT(file));
-	file.close();
-	file.open("/opt/robosub/rosWorkspace/SubImageRecognition/path.tree");
-	trees.push_back(DLT(file));
-	file.close();
-	file.open("/opt/robosub/rosWorkspace/SubImageRecognition/parking.tree");
-	trees.push_back(DLT(file));
-	file.close();
-	file.open("/opt/robosub/rosWorkspace/SubImageRecognition/pizzabox.tree");
-	trees.push_back(DLT(file));
-	file.close();
-
 	ros::init(argc, argv, "ImageRecognition");
 	ros::NodeHandle nodeHandle;
 	image_transport::ImageTransport imageTransport(nodeHandle);
 
-	forwardPublisher = imageTransport.advertise("forward_camera/image_raw", 1);
-	downwardPublisher = imageTransport.advertise("downward_camera/image_raw", 1);
-	forwardThresh = imageTransport.advertise("forward_camera/threshold", 1);
-	downwardThresh = imageTransport.advertise("downward_camera/threshold", 1);
-
-	image_transport::Subscriber forwardSubscriber = imageTransport.subscribe("/stereo/right/image_raw", 1, forwardCallback);
-	image_transport::Subscriber downwardSubscriber = imageTransport.subscribe("image_raw", 1, downwardCallback);
-
+	// Trees come from the bundle if there is one, or else the .tree files
 	initObjects();
+	string bundle;
+	ros::NodeHandle("~").param("bundle", bundle, string(BUNDLE_DEFAULT));
+	if (!loadClassifiers(bundle)) {
+		ROS_INFO("No bundle at %s, reading the trees from %s", bundle.c_str(), TREE_DIRECTORY);
+		if (!loadClassifiers(TREE_DIRECTORY)) {
+			ROS_ERROR("Could not load the trees from %s", TREE_DIRECTORY);
+			return 1;
+		}
+	}
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		objectPublishers.push_back(advertiseObject(nodeHandle, objects[i]));
+	}
+	pizzaPublisher = advertiseObject(nodeHandle, *pizzaObj);
+
+	// How many times coarser than the sampling grid a coarse search looks
+	ros::NodeHandle("~").param("pyramid_levels", pyramidLevels, PYRAMID_LEVELS_DEFAULT);
+	pyramidLevels = max(0, pyramidLevels);
+	// Whether cameras may search and sample less to stay within the budget
+	ros::NodeHandle("~").param("adaptive", adaptive, false);
+	// Whether to reuse the labels of samples that have barely changed
+	ros::NodeHandle("~").param("coherent", coherent, false);
+	// The rectified stereo pair the forward camera is the right half of
+	ros::NodeHandle("~").param("stereo_focal_length", stereoFocalLength, 0.0);
+	ros::NodeHandle("~").param("stereo_baseline", stereoBaseline, 0.0);
+	ros::NodeHandle("~").param("stereo_max_disparity", stereoMaxDisparity, STEREO_MAX_DISPARITY_DEFAULT);
+	ros::NodeHandle("~").param("latency_budget", latencyBudget, LATENCY_BUDGET_DEFAULT);
+
+	// Each camera's own worker thread helps the pool while it waits on it
+	// hardware_concurrency is 0 when it can't tell
+	unsigned int cores = boost::thread::hardware_concurrency();
+	pool = new ThreadPool(cores > 1 ? cores - 1 : 1);
+	Camera forward(CAMERA_FORWARD, imageTransport,
+			"forward_camera/image_raw", "forward_camera/threshold");
+	Camera downward(CAMERA_DOWNWARD, imageTransport,
+			"downward_camera/image_raw", "downward_camera/threshold");
+
+	// Latency of every stage, on the diagnostics topic now and then and in
+	// full on request
+	double diagnosticsPeriod;
+	ros::NodeHandle("~").param("diagnostics_period", diagnosticsPeriod, DIAGNOSTICS_PERIOD_DEFAULT);
+	cameras.push_back(&forward);
+	cameras.push_back(&downward);
+	diagnosticsPublisher = nodeHandle.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	ros::WallTimer diagnosticsTimer = nodeHandle.createWallTimer(ros::WallDuration(diagnosticsPeriod), publishDiagnostics);
+	ros::ServiceServer dumpService = ros::NodeHandle("~").advertiseService("dump_latency", dumpLatency);
+
+	ros::ServiceServer listService = nodeHandle.advertiseService(string(NAMESPACE_ROOT) + "list_algorithms", listAlgorithms);
+	ros::ServiceServer updateService = nodeHandle.advertiseService(string(NAMESPACE_ROOT) + "update_algorithm", updateAlgorithm);
+	ros::ServiceServer switchService = nodeHandle.advertiseService(string(NAMESPACE_ROOT) + "switch_algorithm", switchAlgorithm);
+
+	image_transport::Subscriber forwardSubscriber = imageTransport.subscribe("/stereo/right/image_raw", 1, &Camera::callback, &forward);
+	image_transport::Subscriber leftSubscriber;
+	if (stereoBaseline > 0) {
+		leftSubscriber = imageTransport.subscribe("/stereo/left/image_raw", 1, &Camera::leftCallback, &forward);
+	}
+	image_transport::Subscriber downwardSubscriber = imageTransport.subscribe("image_raw", 1, &Camera::callback, &downward);
+
 	ros::spin();
+	forward.stop();
+	downward.stop();
+	delete pool;
 	return 0;
 }
@@ -0,0 +1,57 @@
+#include "LatencyHistogram.h"
+#include <math.h>
+
+using namespace std;
+
+namespace {
+
+const int STEPS_PER_OCTAVE = 4;
+const double SMALLEST = 0.000001;
+
+}
+
+LatencyHistogram::LatencyHistogram() {
+	for (int i = 0; i < BUCKETS; i++) {
+		counts[i] = 0;
+	}
+}
+
+void LatencyHistogram::record(double seconds) {
+	int bucket = 0;
+	if (seconds > SMALLEST) {
+		bucket = (int) ceil(log2(seconds / SMALLEST) * STEPS_PER_OCTAVE);
+		bucket = bucket < BUCKETS ? bucket : BUCKETS - 1;
+	}
+	__sync_fetch_and_add(&counts[bucket], 1);
+}
+
+void LatencyHistogram::snapshot(vector<unsigned long>& copy) const {
+	copy.resize(BUCKETS);
+	for (int i = 0; i < BUCKETS; i++) {
+		copy[i] = counts[i];
+	}
+}
+
+double LatencyHistogram::bucketLimit(int bucket) {
+	return SMALLEST * pow(2.0, (double) bucket / STEPS_PER_OCTAVE);
+}
+
+unsigned long LatencyHistogram::total(const vector<unsigned long>& counts) {
+	unsigned long sum = 0;
+	for (unsigned int i = 0; i < counts.size(); i++) {
+		sum += counts[i];
+	}
+	return sum;
+}
+
+double LatencyHistogram::percentile(const vector<unsigned long>& counts, double fraction) {
+	unsigned long wanted = (unsigned long) ceil(total(counts) * fraction);
+	unsigned long seen = 0;
+	for (unsigned int i = 0; i < counts.size(); i++) {
+		seen += counts[i];
+		if (seen >= wanted && seen > 0) {
+			return bucketLimit(i);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include <vector>
+
+// Counts of latencies in buckets a quarter of a power of two wide, from a
+// microsecond up to about a minute. Recording is a single atomic increment,
+// so any thread can record while another takes a snapshot.
+class LatencyHistogram {
+public:
+	static const int BUCKETS = 104;
+
+	LatencyHistogram();
+	void record(double seconds);
+	void snapshot(std::vector<unsigned long>& counts) const;
+
+	// Upper bound in seconds of what lands in a bucket
+	static double bucketLimit(int bucket);
+	static unsigned long total(const std::vector<unsigned long>& counts);
+	// The bucket limit below which the given fraction of a snapshot falls
+	static double percentile(const std::vector<unsigned long>& counts, double fraction);
+
+private:
+	unsigned long counts[BUCKETS];
+};
+
+#endif
@@ -0,0 +1,1013 @@
+#include "Recognition.h"
+#include <algorithm>
+#include <fstream>
+#include <limits.h>
+#include <math.h>
+#include <sstream>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <boost/bind.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ClassifierBundle.h"
+#include "HSVSampler.h"
+
+using namespace cv;
+using namespace std;
+
+const char* STAGE_NAMES[STAGE_COUNT] = {
+	"rotate", "hsv", "classify", "blobs", "analyse", "track"
+};
+
+const char* CLASSIFIER_NAMES[CLASSIFIER_COUNT] = {
+	"tree", "lookup", "range"
+};
+
+// GLOBALS  :/  HA HA AH WELL
+
+vector<Object> objects;
+vector<bool> objectTracking;
+ThreadPool* pool;
+int pyramidLevels = PYRAMID_LEVELS_DEFAULT;
+
+bool pizzaCheck=false;
+Object* pizzaObj;	
+
+
+// FUNCTIONS
+
+//Need to add enumTypes to Objects
+void initObjects() {
+		objects.push_back(Object(
+				"gate",
+				FLAG_ENABLED | FLAG_ROI_TRACKING | FLAG_COARSE_TO_FINE,
+				CAMERA_FORWARD,
+				ANALYSIS_RECTANGLE,
+				2,
+				CONFIDENCE_RECTANGLE,
+				Scalar(0, 128, 255), // Orange
+				ANNOTATION_ROTATION,
+				1,
+				CLASSIFIER_LOOKUP
+		));
+		objectTracking.push_back(true);
+
+		objects.push_back(Object(
+				"buoys/red",
+                1,
+				CAMERA_FORWARD,
+				ANALYSIS_RECTANGLE,
+				1,
+				CONFIDENCE_CIRCLE,
+				Scalar(0, 0, 255), // Red
+				ANNOTATION_RADIUS,
+				2,
+				CLASSIFIER_LOOKUP
+		));
+		objectTracking.push_back(true);
+		// objects.push_back(Object(
+		// 		"buoys/green",
+  //               1,
+		// 		CAMERA_FORWARD,
+		// 		ANALYSIS_RECTANGLE,
+		// 		1,
+		// 		CONFIDENCE_CIRCLE,
+		// 		Scalar(0, 255, 0), // Green
+		// 		ANNOTATION_RADIUS,
+		// 		3
+		// ));
+		// objects.push_back(Object(
+		// 		"buoys/yellow",
+  //               1,
+		// 		CAMERA_FORWARD,
+		// 		ANALYSIS_RECTANGLE,
+		// 		1,
+		// 		CONFIDENCE_CIRCLE,
+		// 		Scalar(0, 255, 255), // Yellow
+		// 		ANNOTATION_RADIUS,
+		// 		4
+		// ));
+		objects.push_back(Object(
+				"paths",
+				FLAG_ENABLED | FLAG_ROI_TRACKING | FLAG_COARSE_TO_FINE,
+				CAMERA_DOWNWARD,
+				ANALYSIS_MOMENTS,
+				2,
+				CONFIDENCE_RECTANGLE,
+				Scalar(0, 128, 255), // Orange
+				ANNOTATION_ROTATION,
+				3,
+				CLASSIFIER_LOOKUP
+		));
+		objectTracking.push_back(true);
+		objects.push_back(Object(
+				"parking",
+                1,
+				CAMERA_FORWARD,
+				ANALYSIS_RECTANGLE,
+				3,
+				CONFIDENCE_RECTANGLE,
+				Scalar(255, 0, 0), // Blue
+				ANNOTATION_ROTATION,
+				4,
+				CLASSIFIER_LOOKUP
+		));
+		objectTracking.push_back(true);
+		// objects.push_back(Object(
+		// 		"red led buoy",
+  //               1,
+		// 		CAMERA_FORWARD,
+		// 		ANALYSIS_RECTANGLE,
+		// 		1,
+		// 		CONFIDENCE_RECTANGLE,
+		// 		Scalar(255, 0, 0), // Blue
+		// 		ANNOTATION_ROTATION,
+		// 		7
+		// ));
+
+
+        pizzaObj=new Object(
+					"pizza_box",
+	                1,
+					CAMERA_FORWARD,
+					ANALYSIS_RECTANGLE,
+					2,
+					CONFIDENCE_RECTANGLE,
+					Scalar(0, 255, 255),
+					ANNOTATION_ROTATION,
+					255,
+					CLASSIFIER_LOOKUP
+				);
+        objectTracking.push_back(false);
+
+}
+
+// The tree for each object, in the same order, then the pizza box's. These
+// are the file names without ".tree" and the names in a bundle.
+const char* TREE_NAMES[] = {"gate", "redbuoy", "path", "parking", "pizzabox"};
+const int TREE_COUNT = sizeof(TREE_NAMES) / sizeof(TREE_NAMES[0]);
+
+boost::mutex classifiersMutex;
+ClassifiersPtr classifiers;
+string classifierSource;
+
+bool isDirectory(const string& path) {
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+bool readTree(const string& source, int index, vector<ForestDLT>& trees) {
+	if (isDirectory(source)) {
+		ifstream file((source + "/" + TREE_NAMES[index] + ".tree").c_str());
+		if (!file) {
+			return false;
+		}
+		trees[index] = ForestDLT(file);
+		return true;
+	}
+	ClassifierBundle bundle;
+	int found;
+	if (!bundle.Map(source) || (found = bundle.Find(TREE_NAMES[index])) < 0) {
+		return false;
+	}
+	trees[index] = bundle.Forest(TREE_NAMES[index]);
+	return true;
+}
+
+// Replace the bits in mask of one object's flags in a set about to be swapped in
+void changeFlags(Classifiers& set, int index, int flags, int mask) {
+	set.flags[index] = (set.flags[index] & ~mask) | (flags & mask);
+}
+
+// Changes the flags of object index, if any, in the same swap
+void replaceClassifiers(const vector<ForestDLT>& trees, const string& source,
+		int index = -1, int flags = 0, int mask = 0) {
+	boost::shared_ptr<Classifiers> replacement(new Classifiers());
+	replacement->trees = trees;
+	for (unsigned int i = 0; i < trees.size(); i++) {
+		replacement->luts.push_back(LutDLT(trees[i]));
+	}
+	boost::lock_guard<boost::mutex> lock(classifiersMutex);
+	if (classifiers) {
+		replacement->ranges = classifiers->ranges;
+		replacement->flags = classifiers->flags;
+		replacement->methods = classifiers->methods;
+	} else {
+		replacement->ranges.resize(TREE_COUNT);
+		for (unsigned int i = 0; i < objects.size(); i++) {
+			replacement->flags.push_back(objects[i].flags);
+			replacement->methods.push_back(objects[i].classifier);
+		}
+	}
+	if (index >= 0) {
+		changeFlags(*replacement, index, flags, mask);
+	}
+	classifiers = replacement;
+	classifierSource = source;
+}
+
+bool loadClassifiers(const string& source) {
+	vector<ForestDLT> trees;
+	if (isDirectory(source)) {
+		for (int i = 0; i < TREE_COUNT; i++) {
+			ifstream file((source + "/" + TREE_NAMES[i] + ".tree").c_str());
+			if (!file) {
+				return false;
+			}
+			trees.push_back(ForestDLT(file));
+		}
+	} else {
+		ClassifierBundle bundle;
+		if (!bundle.Map(source)) {
+			return false;
+		}
+		for (int i = 0; i < TREE_COUNT; i++) {
+			int found = bundle.Find(TREE_NAMES[i]);
+			if (found < 0) {
+				return false;
+			}
+			trees.push_back(bundle.Forest(TREE_NAMES[i]));
+		}
+	}
+	replaceClassifiers(trees, source);
+	return true;
+}
+
+bool reloadClassifier(int index, int flags, int mask) {
+	string source;
+	vector<ForestDLT> trees;
+	{
+		boost::lock_guard<boost::mutex> lock(classifiersMutex);
+		if (!classifiers || index < 0 || index >= TREE_COUNT) {
+			return false;
+		}
+		source = classifierSource;
+		trees = classifiers->trees;
+	}
+	if (!readTree(source, index, trees)) {
+		return false;
+	}
+	replaceClassifiers(trees, source, index, flags, mask);
+	return true;
+}
+
+bool setClassifierRange(int index, const HSVRange& range, int flags, int mask) {
+	boost::lock_guard<boost::mutex> lock(classifiersMutex);
+	if (!classifiers || index < 0 || index >= TREE_COUNT) {
+		return false;
+	}
+	boost::shared_ptr<Classifiers> replacement(new Classifiers(*classifiers));
+	replacement->ranges[index] = range;
+	if (mask) {
+		changeFlags(*replacement, index, flags, mask);
+	}
+	classifiers = replacement;
+	return true;
+}
+
+bool setObjectFlags(int index, int flags, int mask) {
+	boost::lock_guard<boost::mutex> lock(classifiersMutex);
+	if (!classifiers || index < 0 || index >= (int) objects.size()) {
+		return false;
+	}
+	boost::shared_ptr<Classifiers> replacement(new Classifiers(*classifiers));
+	changeFlags(*replacement, index, flags, mask);
+	classifiers = replacement;
+	return true;
+}
+
+bool setObjectClassifier(int index, int classifier) {
+	boost::lock_guard<boost::mutex> lock(classifiersMutex);
+	if (!classifiers || index < 0 || index >= (int) objects.size()
+			|| classifier < 0 || classifier >= CLASSIFIER_COUNT) {
+		return false;
+	}
+	boost::shared_ptr<Classifiers> replacement(new Classifiers(*classifiers));
+	replacement->methods[index] = classifier;
+	classifiers = replacement;
+	return true;
+}
+
+ClassifiersPtr currentClassifiers() {
+	boost::lock_guard<boost::mutex> lock(classifiersMutex);
+	return classifiers;
+}
+
+/*void normalizeValue(Mat& image, Mat& temp) {
+		const static int valueOut[] = {2, 0};
+		const static int valueIn[] = {0, 2};
+		temp.create(image.rows, image.cols, CV_8UC1);
+		mixChannels(&image, 1, &temp, 1, valueOut, 1);
+		normalize(temp, temp, 0, 255, CV_MINMAX);
+		mixChannels(&temp, 1, &image, 1, valueIn, 1);
+}*/
+
+void reduceNoise(Mat& image) {
+		const static Size size(3, 3);
+		const static Point point(1, 1);
+		const static Mat elementRect = getStructuringElement(
+						MORPH_RECT, size, point);
+		erode(image, image, elementRect, point, 5);
+		dilate(image, image, elementRect, point, 2);
+}
+
+// The minimum points are counted at SAMPLE_SIZE spacing, so a blob sampled
+// more sparsely needs fewer
+unsigned int minPoints(int obj, int step) {
+		return ((obj==3) ? MIN_POINTS_PATH : MIN_POINTS) * SAMPLE_SIZE * SAMPLE_SIZE / (step * step);
+}
+
+void findBlobs(BlobLabeler& labeler, const Mat& image, const vector<Rect>& windows,
+				const int offset, const int step, const unsigned int maxBlobs, int obj, vector<Blob>& blobs) {
+		labeler.reset();
+		for (unsigned int i = 0; i < windows.size(); i++) {
+				labeler.label(image, offset, step, obj, windows[i]);
+		}
+		// Keep the biggest 'maxBlobs' blobs that are at least the minimum size
+		labeler.largest(minPoints(obj, step), maxBlobs, blobs);
+}
+
+bool overlaps(const Rect& a, const Rect& b) {
+		return a.x < b.x + b.width && b.x < a.x + a.width
+				&& a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+// Grow windows that overlap into their bounding box until none overlap, so
+// no blob is found twice
+void mergeWindows(vector<Rect>& windows) {
+		for (unsigned int i = 0; i < windows.size(); i++) {
+				for (unsigned int j = i + 1; j < windows.size(); j++) {
+						if (overlaps(windows[i], windows[j])) {
+								int left = min(windows[i].x, windows[j].x);
+								int top = min(windows[i].y, windows[j].y);
+								int right = max(windows[i].x + windows[i].width, windows[j].x + windows[j].width);
+								int bottom = max(windows[i].y + windows[i].height, windows[j].y + windows[j].height);
+								windows[i] = Rect(left, top, right - left, bottom - top);
+								windows.erase(windows.begin() + j);
+								j = i;
+						}
+				}
+		}
+}
+
+void analyzeBlob(Object& object, const Blob& blob, int step,
+				vector<BlobAnalysis>& analyses) {
+		switch (object.analysisType) {
+		case ANALYSIS_RECTANGLE:
+				analyses.push_back(BlobAnalysis(blob,
+								object.confidenceType == CONFIDENCE_CIRCLE ?
+								blob.fitEllipse(step) : blob.fitRectangle(step)));
+				break;
+		case ANALYSIS_MOMENTS:
+				analyses.push_back(BlobAnalysis(blob, step));
+				break;
+		}
+}
+
+float computeConfidence(Object& object, BlobAnalysis& a, int step) {
+		// A return value of -1 indicates 'divide by zero' error
+		// A return value of -2 indicates 'unknown confidence type' error
+		if (object.analysisType == ANALYSIS_MOMENTS) {
+				return a.fill;
+		}
+		int expectedPoints;
+		switch (object.confidenceType) {
+		case CONFIDENCE_RECTANGLE:
+				expectedPoints = (a.width * a.height) / (step * step);
+				break;
+		case CONFIDENCE_CIRCLE:
+				expectedPoints =
+								(M_PI * a.width * a.height) / (4 * step * step);
+				break;
+		default:
+				return -2; // Unknown confidence type
+		}
+		if (expectedPoints <= 0) {
+				return -1; // Divide by zero
+		} else {
+				float confidence = ((float) a.size) / ((float) expectedPoints);
+				if (confidence > 1) {
+						return 1;
+				} else {
+						return confidence;
+				}
+		}
+}
+
+void annotateImage(Mat& image, Object& object, BlobAnalysis& a, float confidence) {
+		int r, x, y;
+		stringstream text;
+		text<<"Confidence: "<<confidence;
+		switch (object.annotationType) {
+		case ANNOTATION_ROTATION:
+				x = (int) (a.height / 2.0 * cos(a.rotation));
+				y = (int) (a.height / 2.0 * sin(a.rotation));
+				circle(image, Point(a.center_x, a.center_y), 1,
+								object.annotationColor, 5, CV_AA);
+				line(image, Point(a.center_x, a.center_y),
+								Point(a.center_x + x, a.center_y + y),
+								object.annotationColor, 1, CV_AA);
+				break;
+		case ANNOTATION_RADIUS:
+				r = (int) ((a.width + a.height) / 4.0);
+				circle(image, Point(a.center_x, a.center_y), r,
+								object.annotationColor, 2, CV_AA);
+				break;
+		}
+		putText(image, text.str(), Point(a.center_x +5, a.center_y+5), 1, 3, Scalar(255, 255, 255));
+}
+
+CoherenceCache::CoherenceCache():
+key(-1)
+,hits(0)
+,lookups(0)
+{
+}
+
+// TRACKING
+
+BlobTracker::BlobTracker():
+nextId(0)
+{
+}
+
+void BlobTracker::update(int frame, int type, const vector<BlobAnalysis>& blobs, vector<int>& ids) {
+	// Every blob within the gate of a track, nearest first
+	pairings.clear();
+	for (unsigned int t = 0; t < tracked.size(); t++) {
+		const BlobTrack& track = tracked[t];
+		if (track.objType != type) {
+			continue;
+		}
+		int gap = frame - track.lastSeen;
+		int x = track.x + track.dx * gap;
+		int y = track.y + track.dy * gap;
+		int gate = track.radius + TRACKING_GATE_MARGIN * gap;
+		for (unsigned int b = 0; b < blobs.size(); b++) {
+			int dx = blobs[b].center_x - x;
+			int dy = blobs[b].center_y - y;
+			if (dx * dx + dy * dy <= gate * gate) {
+				Pairing pairing;
+				pairing.distance = dx * dx + dy * dy;
+				pairing.track = t;
+				pairing.blob = b;
+				pairings.push_back(pairing);
+			}
+		}
+	}
+	sort(pairings.begin(), pairings.end());
+
+	trackMatched.assign(tracked.size(), false);
+	blobMatched.assign(blobs.size(), false);
+	ids.assign(blobs.size(), -1);
+	for (unsigned int p = 0; p < pairings.size(); p++) {
+		const Pairing& pairing = pairings[p];
+		if (trackMatched[pairing.track] || blobMatched[pairing.blob]) {
+			continue;
+		}
+		trackMatched[pairing.track] = blobMatched[pairing.blob] = true;
+		BlobTrack& track = tracked[pairing.track];
+		const BlobAnalysis& blob = blobs[pairing.blob];
+		int gap = frame - track.lastSeen;
+		int dx = (blob.center_x - track.x) / gap;
+		int dy = (blob.center_y - track.y) / gap;
+		track.dx = track.lifetime ? (track.dx + dx) / 2 : dx;
+		track.dy = track.lifetime ? (track.dy + dy) / 2 : dy;
+		track.x = blob.center_x;
+		track.y = blob.center_y;
+		track.radius = (blob.width + blob.height) / 2;
+		track.lastSeen = frame;
+		++track.lifetime;
+		if (track.lifetime >= FRAME_MARGIN_OF_ERROR) {
+			ids[pairing.blob] = track.id;
+		}
+	}
+
+	for (unsigned int b = 0; b < blobs.size(); b++) {
+		if (!blobMatched[b]) {
+			tracked.push_back(BlobTrack(freeId(), blobs[b].center_x, blobs[b].center_y,
+					(blobs[b].width + blobs[b].height) / 2, frame, type));
+		}
+	}
+}
+
+// The next id after the last one given out that no live track holds. Only
+// if all of them are held does an id get shared.
+int BlobTracker::freeId() {
+	for (int tries = 0; tries < TRACK_ID_LIMIT; tries++) {
+		int id = nextId;
+		nextId = (nextId + 1) % TRACK_ID_LIMIT;
+		bool held = false;
+		for (unsigned int t = 0; t < tracked.size() && !held; t++) {
+			held = tracked[t].id == id;
+		}
+		if (!held) {
+			return id;
+		}
+	}
+	return nextId;
+}
+
+void BlobTracker::expire(int frame) {
+	// Order doesn't matter, so the last track fills the gap
+	for (unsigned int t = 0; t < tracked.size(); ) {
+		if (tracked[t].lastSeen < frame - FRAME_MARGIN_OF_ERROR) {
+			tracked[t] = tracked.back();
+			tracked.pop_back();
+		} else {
+			++t;
+		}
+	}
+}
+
+const vector<BlobTrack>& BlobTracker::tracks() const {
+	return tracked;
+}
+
+// FRAME PIPELINE
+
+namespace {
+
+double now() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+}
+
+FramePipeline::FramePipeline(int camera):
+camera(camera)
+,step(SAMPLE_SIZE)
+,roiTracking(false)
+,coherent(false)
+,offset(0)
+,avgHue(0)
+,avgSat(0)
+,avgBright(0)
+,windows(objects.size())
+,refineWindows(objects.size())
+,thresholds(objects.size())
+,rowLabels(objects.size())
+,labelers(objects.size())
+,blobs(objects.size())
+,analyses(objects.size())
+,objectSeconds(objects.size(), vector<double>(STAGE_COUNT))
+,caches(objects.size())
+,hits(0)
+,lookups(0)
+,curFrame(0)
+{
+	setSampleStep(SAMPLE_SIZE);
+	fill(seconds, seconds + STAGE_COUNT, 0.0);
+}
+
+void FramePipeline::setSampleStep(int spacing) {
+	if (spacing != step) {
+		// The cached samples are of another grid
+		for (unsigned int i = 0; i < caches.size(); i++) {
+			caches[i].key = -1;
+		}
+	}
+	step = spacing;
+	offset %= step;
+	samples.step = step;
+	coarseSamples.step = step << pyramidLevels;
+}
+
+int FramePipeline::sampleStep() const {
+	return step;
+}
+
+void FramePipeline::setRoiTracking(bool enabled) {
+	roiTracking = enabled;
+}
+
+bool FramePipeline::isRoiTracking() const {
+	return roiTracking;
+}
+
+void FramePipeline::setCoherent(bool enabled) {
+	coherent = enabled;
+	for (unsigned int i = 0; i < caches.size(); i++) {
+		caches[i].key = -1;
+	}
+}
+
+bool FramePipeline::isCoherent() const {
+	return coherent;
+}
+
+unsigned long FramePipeline::cacheHits() const {
+	return hits;
+}
+
+unsigned long FramePipeline::cacheLookups() const {
+	return lookups;
+}
+
+Size FramePipeline::uprightSize(const Mat& raw) const {
+	return camera == CAMERA_DOWNWARD ? Size(raw.rows, raw.cols) : Size(raw.cols, raw.rows);
+}
+
+const vector<int>& FramePipeline::activeObjects() const {
+	return active;
+}
+
+const double* FramePipeline::stageSeconds() const {
+	return seconds;
+}
+
+const vector<double>& FramePipeline::objectStageSeconds(int index) const {
+	return objectSeconds[index];
+}
+
+void FramePipeline::process(const Mat& raw, Mat& image, vector<Detection>& detections) {
+	// Pick up classifiers swapped in since the last frame
+	ClassifiersPtr latest = currentClassifiers();
+	if (latest != classifiers) {
+		classifiers = latest;
+		luts = latest->luts;
+		for (unsigned int i = 0; i < caches.size(); i++) {
+			caches[i].key = -1;
+		}
+	}
+
+	double start = now();
+	rotated = image;
+	// Rotate image upright. The forward camera is copied so annotating never
+	// scribbles on the shared incoming image.
+	//TODO: find a better way to stop forward camera rotation
+	if (camera == CAMERA_DOWNWARD) {
+		rotate(raw);
+	} else {
+		raw.copyTo(rotated);
+	}
+	double stop = now();
+	seconds[STAGE_ROTATE] = stop - start;
+
+	// Segment the sampled pixels into HSV
+	start = stop;
+	sampleFrame();
+	stop = now();
+	seconds[STAGE_HSV] = stop - start;
+
+	// Classify and find blobs for every applicable object in parallel
+	active.clear();
+	tasks.clear();
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		if (objectTracking[i] && (classifiers->flags[i] & FLAG_ENABLED) && objects[i].camera == camera) {
+			active.push_back(i);
+			windows[i] = searchWindow(i);
+			tasks.push_back(boost::bind(&FramePipeline::detect, this, i));
+		}
+	}
+	pool->run(tasks);
+	seconds[STAGE_CLASSIFY] = seconds[STAGE_BLOBS] = seconds[STAGE_ANALYSE] = 0;
+	hits = lookups = 0;
+	for (unsigned int a = 0; a < active.size(); a++) {
+		for (int stage = STAGE_CLASSIFY; stage <= STAGE_ANALYSE; stage++) {
+			seconds[stage] += objectSeconds[active[a]][stage];
+		}
+		hits += caches[active[a]].hits;
+		lookups += caches[active[a]].lookups;
+	}
+
+	// Tracking stays in order on the camera's thread
+	start = now();
+	detections.clear();
+	for (unsigned int a = 0; a < active.size(); a++) {
+			Object& object = objects[active[a]];
+			vector<BlobAnalysis>& blobAnalyses = analyses[active[a]];
+			confident.clear();
+			confidences.clear();
+			// Iterate through all blob analysis objects
+			for (unsigned int j = 0; j < blobAnalyses.size(); j++) {
+					BlobAnalysis& analysis = blobAnalyses[j];
+					float tempConfidence=computeConfidence(object, analysis, step);
+					bool path = object.enumType == 3;
+					if(tempConfidence > (path ? MIN_PATH_CONFIDENCE : MIN_CONFIDENCE)
+							&& (!path || analysis.elongation >= MIN_PATH_ELONGATION))
+					{
+						confident.push_back(analysis);
+						confidences.push_back(tempConfidence);
+					}
+			}
+			tracker.update(curFrame, object.enumType, confident, trackIds);
+			for (unsigned int k = 0; k < confident.size(); k++) {
+				if (trackIds[k] >= 0) {
+					detections.push_back(Detection(active[a], trackIds[k], confident[k], confidences[k]));
+				}
+			}
+	}
+	tracker.expire(curFrame);
+	++curFrame;
+	offset = (offset + 1) % step;
+	seconds[STAGE_TRACK] = now() - start;
+}
+
+void FramePipeline::drawThresholds(Mat& combined) const {
+	combined.setTo(Scalar(0));
+	for (unsigned int a = 0; a < active.size(); a++) {
+		const vector<Rect>& refine = refineWindows[active[a]];
+		for (unsigned int i = 0; i < refine.size(); i++) {
+			Mat part = combined(refine[i]);
+			max(part, thresholds[active[a]](refine[i]), part);
+		}
+	}
+}
+
+// Turn the downward camera's frame upright (counterclockwise) into rotated
+// with a single remap, whose map is only worked out when the frame size
+// changes
+void FramePipeline::rotate(const Mat& raw) {
+	if (raw.cols != rotateSize.width || raw.rows != rotateSize.height) {
+		// Upright pixel (x, y) comes from raw pixel (cols - 1 - y, x)
+		Mat mapX(raw.cols, raw.rows, CV_32FC1), mapY(raw.cols, raw.rows, CV_32FC1), unused;
+		for (int y = 0; y < raw.cols; y++) {
+			float* xs = mapX.ptr<float>(y);
+			float* ys = mapY.ptr<float>(y);
+			for (int x = 0; x < raw.rows; x++) {
+				xs[x] = raw.cols - 1 - y;
+				ys[x] = x;
+			}
+		}
+		convertMaps(mapX, mapY, rotateMap, unused, CV_16SC2, true);
+		rotateSize = Size(raw.cols, raw.rows);
+	}
+	remap(raw, rotated, rotateMap, Mat(), INTER_NEAREST);
+}
+
+// Convert just the sampled pixels to HSV planes, working out the frame
+// averages the trees split on in the same pass
+void FramePipeline::sampleFrame() {
+	samples.cols = sampleColumns(rotated.cols, offset, step);
+	int sampleRows = sampleColumns(rotated.rows, offset, step);
+	samples.hues.resize(samples.cols * sampleRows);
+	samples.sats.resize(samples.hues.size());
+	samples.brights.resize(samples.hues.size());
+	if (!samples.hues.empty()) {
+		sampleHSV(rotated, offset, step, &samples.hues[0], &samples.sats[0], &samples.brights[0],
+				avgHue, avgSat, avgBright);
+	}
+
+	if (pyramidLevels > 0) {
+		int factor = 1 << pyramidLevels;
+		coarseSamples.cols = (samples.cols + factor - 1) / factor;
+		int coarseRows = (sampleRows + factor - 1) / factor;
+		coarseSamples.hues.resize(coarseSamples.cols * coarseRows);
+		coarseSamples.sats.resize(coarseSamples.hues.size());
+		coarseSamples.brights.resize(coarseSamples.hues.size());
+		int n = 0;
+		for (int r = 0; r < sampleRows; r += factor) {
+			for (int c = 0; c < samples.cols; c += factor, n++) {
+				coarseSamples.hues[n] = samples.hues[r * samples.cols + c];
+				coarseSamples.sats[n] = samples.sats[r * samples.cols + c];
+				coarseSamples.brights[n] = samples.brights[r * samples.cols + c];
+			}
+		}
+	}
+}
+
+// The whole frame, starting on the sampling grid
+Rect FramePipeline::fullWindow() {
+	return Rect(offset, offset, max(0, rotated.cols - offset), max(0, rotated.rows - offset));
+}
+
+// Where to look for an object this frame. Once every track of the object is
+// confirmed, only a window around where each should be now is searched,
+// until a track is lost or a periodic full scan comes round. Windows always
+// start on the sampling grid.
+Rect FramePipeline::searchWindow(int index) {
+	Object& object = objects[index];
+	Rect full = fullWindow();
+	if (!((classifiers->flags[index] & FLAG_ROI_TRACKING) || roiTracking) || curFrame % ROI_FULL_SCAN_FRAMES == 0) {
+		return full;
+	}
+	int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+	const vector<BlobTrack>& tracks = tracker.tracks();
+	for (unsigned int i = 0; i < tracks.size(); i++) {
+		const BlobTrack& track = tracks[i];
+		if (track.objType != object.enumType) {
+			continue;
+		}
+		if (track.lifetime < FRAME_MARGIN_OF_ERROR || track.lastSeen != curFrame - 1) {
+			return full;
+		}
+		// Assume it keeps moving as it did between the last two sightings
+		int x = track.x + track.dx;
+		int y = track.y + track.dy;
+		int reach = track.radius + abs(track.dx) + abs(track.dy) + ROI_MARGIN;
+		left = min(left, x - reach);
+		top = min(top, y - reach);
+		right = max(right, x + reach);
+		bottom = max(bottom, y + reach);
+	}
+	left = max(offset, offset + (left - offset) / step * step);
+	top = max(offset, offset + (top - offset) / step * step);
+	right = min(rotated.cols, right);
+	bottom = min(rotated.rows, bottom);
+	if (right <= left || bottom <= top) {
+		return full;
+	}
+	return Rect(left, top, right - left, bottom - top);
+}
+
+// Classify the samples of a grid that fall in a window into an object's
+// threshold plane. The window must start on the grid.
+void FramePipeline::classify(int index, const SampleGrid& grid, const Rect& window) {
+	Mat& threshold = thresholds[index];
+	if (grid.hues.empty()) {
+		return;
+	}
+	int firstCol = (window.x - offset) / grid.step;
+	int count = min(grid.cols - firstCol, (window.width + grid.step - 1) / grid.step);
+	int bottom = window.y + window.height;
+	if (count <= 0) {
+		return;
+	}
+	vector<unsigned char>& labels = rowLabels[index];
+	labels.resize(count);
+	for (int i = window.y, start = (window.y - offset) / grid.step * grid.cols + firstCol;
+			i < bottom; i += grid.step, start += grid.cols) {
+		if (coherent && &grid == &samples) {
+			classifyCoherent(index, start, count, &labels[0]);
+		} else {
+			classifySamples(index, &grid.hues[start], &grid.sats[start], &grid.brights[start],
+					count, &labels[0]);
+		}
+		uint8_t* row = threshold.ptr<uint8_t>(i);
+		for (int j = window.x, n = 0; n < count; j += grid.step, n++) {
+			row[j]=(labels[n] ? (labels[n]*10+200) : 0);
+		}
+	}
+}
+
+// How an object's samples are classified this frame. A forest gives the
+// same labels through its lookup table as by walking every tree, for the
+// cost of one lookup instead of a walk per tree.
+int FramePipeline::classifierFor(int index) const {
+	int method = classifiers->methods[index];
+	if (method == CLASSIFIER_TREE && classifiers->trees[index].Size() > 1) {
+		return CLASSIFIER_LOOKUP;
+	}
+	return method;
+}
+
+void FramePipeline::classifySamples(int index, const unsigned char* hues,
+		const unsigned char* sats, const unsigned char* brights, int count, unsigned char* labels) {
+	int method = classifierFor(index);
+	if (method == CLASSIFIER_LOOKUP) {
+		luts[index].ClassifyBatch(hues, sats, brights, count, labels);
+	} else if (method == CLASSIFIER_RANGE) {
+		classifiers->ranges[index].classify(hues, sats, brights, count, objects[index].enumType, labels);
+	} else {
+		classifiers->trees[index].ClassifyBatch(avgSat, avgBright, hues, sats, brights, count, labels);
+	}
+}
+
+// Classify count samples from start in the sample grid, taking the cached
+// label of any that have barely changed since they were last classified
+void FramePipeline::classifyCoherent(int index, int start, int count, unsigned char* labels) {
+	CoherenceCache& cache = caches[index];
+	int size = samples.hues.size();
+	unsigned char* cachedHues = &cache.phases[offset][start];
+	unsigned char* cachedSats = cachedHues + size;
+	unsigned char* cachedBrights = cachedSats + size;
+	unsigned char* cachedLabels = cachedBrights + size;
+	const unsigned char* hues = &samples.hues[start];
+	const unsigned char* sats = &samples.sats[start];
+	const unsigned char* brights = &samples.brights[start];
+	compareSamples(hues, sats, brights, cachedHues, cachedSats, cachedBrights,
+			count, COHERENCE_DELTA, &cache.changed[0]);
+	int misses = 0;
+	for (int n = 0; n < count; n++) {
+		if (cache.changed[n] || cachedLabels[n] == COHERENCE_EMPTY) {
+			cache.misses[misses++] = n;
+		}
+	}
+	cache.lookups += count;
+	cache.hits += count - misses;
+
+	// Gathering only pays while most of the row is reused
+	if (misses > count / 2) {
+		classifySamples(index, hues, sats, brights, count, labels);
+		memcpy(cachedHues, hues, count);
+		memcpy(cachedSats, sats, count);
+		memcpy(cachedBrights, brights, count);
+		memcpy(cachedLabels, labels, count);
+		return;
+	}
+	memcpy(labels, cachedLabels, count);
+	if (misses == 0) {
+		return;
+	}
+	for (int m = 0; m < misses; m++) {
+		int n = cache.misses[m];
+		cache.missHues[m] = cachedHues[n] = hues[n];
+		cache.missSats[m] = cachedSats[n] = sats[n];
+		cache.missBrights[m] = cachedBrights[n] = brights[n];
+	}
+	classifySamples(index, &cache.missHues[0], &cache.missSats[0], &cache.missBrights[0],
+			misses, &cache.missLabels[0]);
+	for (int m = 0; m < misses; m++) {
+		int n = cache.misses[m];
+		labels[n] = cachedLabels[n] = cache.missLabels[m];
+	}
+}
+
+// Classify and label an object's search window on the coarse grid, and make
+// a window at full resolution around every coarse blob that could be big
+// enough once refined
+void FramePipeline::coarseSearch(int index, vector<Rect>& refine) {
+	const Rect& window = windows[index];
+	int tempenum=objects[index].enumType;
+	int value=(tempenum ? (tempenum*10+200) : 0);
+	int factor = 1 << pyramidLevels;
+	unsigned int coarseMin = max(1, (int) (minPoints(value, step) * PYRAMID_MIN_POINTS_SHARE) / (factor * factor));
+	classify(index, coarseSamples, window);
+	labelers[index].reset();
+	const vector<Blob>& coarse = labelers[index].label(thresholds[index], offset, coarseSamples.step, value, window);
+	refine.clear();
+	for (unsigned int i = 0; i < coarse.size(); i++) {
+		if (coarse[i].size < coarseMin) {
+			continue;
+		}
+		// The blob's true edge can be up to a coarse step past its samples
+		int left = max(window.x, offset + (coarse[i].minX - coarseSamples.step - offset) / step * step);
+		int top = max(window.y, offset + (coarse[i].minY - coarseSamples.step - offset) / step * step);
+		int right = min(window.x + window.width, coarse[i].maxX + coarseSamples.step + 1);
+		int bottom = min(window.y + window.height, coarse[i].maxY + coarseSamples.step + 1);
+		refine.push_back(Rect(left, top, right - left, bottom - top));
+	}
+	mergeWindows(refine);
+}
+
+// Everything for one object that doesn't touch state shared between objects,
+// so it can run on the pool alongside the other objects
+void FramePipeline::detect(int index) {
+		Object& object = objects[index];
+		vector<double>& times = objectSeconds[index];
+		double start = now();
+		thresholds[index].create(rotated.rows, rotated.cols, CV_8U);
+		int method = classifierFor(index);
+		if (method == CLASSIFIER_LOOKUP) {
+			luts[index].Update(avgSat, avgBright);
+		}
+		if (coherent) {
+			// Labels from trees also depend on which side of the tree's
+			// thresholds the frame averages fall
+			CoherenceCache& cache = caches[index];
+			int key = method;
+			if (method != CLASSIFIER_RANGE) {
+				key += CLASSIFIER_COUNT * (1 + luts[index].AverageBin(avgSat, avgBright));
+			}
+			if (key != cache.key || cache.phases.size() != (unsigned int) step) {
+				cache.key = key;
+				cache.phases.resize(step);
+				for (int phase = 0; phase < step; phase++) {
+					cache.phases[phase].clear();
+				}
+			}
+			vector<unsigned char>& phase = cache.phases[offset];
+			if (phase.size() != samples.hues.size() * 4) {
+				phase.assign(samples.hues.size() * 4, COHERENCE_EMPTY);
+			}
+			cache.changed.resize(samples.cols);
+			cache.misses.resize(samples.cols);
+			cache.missHues.resize(samples.cols);
+			cache.missSats.resize(samples.cols);
+			cache.missBrights.resize(samples.cols);
+			cache.missLabels.resize(samples.cols);
+		}
+		caches[index].hits = caches[index].lookups = 0;
+		vector<Rect>& refine = refineWindows[index];
+		if ((classifiers->flags[index] & FLAG_COARSE_TO_FINE) && pyramidLevels > 0
+				&& windows[index].area() == fullWindow().area()) {
+			// Only look at full resolution where the coarse grid found something
+			coarseSearch(index, refine);
+		} else {
+			refine.assign(1, windows[index]);
+		}
+		for (unsigned int i = 0; i < refine.size(); i++) {
+			classify(index, samples, refine[i]);
+		}
+		// Labelling the coarse grid counts as part of classifying
+		double stop = now();
+		times[STAGE_CLASSIFY] = stop - start;
+		start = stop;
+		//reduceNoise(threshold);
+		int tempenum=object.enumType;
+		findBlobs(labelers[index], thresholds[index], refine, offset, step, object.maxBlobs,
+						(tempenum ? (tempenum*10+200) : 0), blobs[index]);
+		stop = now();
+		times[STAGE_BLOBS] = stop - start;
+		start = stop;
+		analyses[index].clear();
+		for (unsigned int j = 0; j < blobs[index].size(); j++) {
+				analyzeBlob(object, blobs[index][j], step, analyses[index]);
+		}
+		times[STAGE_ANALYSE] = now() - start;
+}
+
@@ -0,0 +1,419 @@
+#ifndef _RECOGNITION_H
+#define _RECOGNITION_H
+
+#define _USE_MATH_DEFINES
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "BlobLabeler.h"
+#include "DLT.h"
+#include "HSVRange.h"
+#include "ThreadPool.h"
+
+// Everything that turns a camera frame into detections, kept apart from ROS
+// so it can run against recorded frames as well as live in ImageRecognition
+
+// CONSTANTS
+
+const int SAMPLE_SIZE = 4;
+const unsigned int MIN_POINTS = 200;
+const unsigned int MIN_POINTS_PATH = 400;
+const float MIN_CONFIDENCE = 0.5;
+const float MIN_PATH_CONFIDENCE = 0.7;
+// A path is a 4' by 6" strip, so anything rounder than this isn't one
+const float MIN_PATH_ELONGATION = 2.0;
+
+const int FLAG_ENABLED = 1;
+const int FLAG_PUBLISH_THRESHOLD = 2;
+const int FLAG_ROI_TRACKING = 4;
+const int FLAG_COARSE_TO_FINE = 8;
+
+const int CAMERA_FORWARD = 0;
+const int CAMERA_DOWNWARD = 1;
+
+const int ANALYSIS_RECTANGLE = 0;
+// Orientation, elongation and fill straight from the blob's moments, with
+// the fill as the confidence
+const int ANALYSIS_MOMENTS = 1;
+
+const int CONFIDENCE_RECTANGLE = 0;
+const int CONFIDENCE_CIRCLE = 1;
+
+const int ANNOTATION_ROTATION = 0;
+const int ANNOTATION_RADIUS = 1;
+
+const int CLASSIFIER_TREE = 0;
+const int CLASSIFIER_LOOKUP = 1;
+// Within the object's HSVRange instead of through its tree
+const int CLASSIFIER_RANGE = 2;
+const int CLASSIFIER_COUNT = 3;
+
+const int FRAME_MARGIN_OF_ERROR=3;
+// A blob can only continue a track whose predicted center is within the
+// track's radius plus this many pixels for every frame it has gone unseen
+const int TRACKING_GATE_MARGIN = 4 * SAMPLE_SIZE;
+// Track ids count up and wrap at this, to fit ImgRecObject's int8 id
+const int TRACK_ID_LIMIT = 128;
+
+// With FLAG_ROI_TRACKING, confirmed tracks are searched for within this many
+// pixels of their predicted outline, and the whole frame is searched again
+// every ROI_FULL_SCAN_FRAMES frames
+const int ROI_MARGIN = 8 * SAMPLE_SIZE;
+const int ROI_FULL_SCAN_FRAMES = 15;
+
+// With coherence, a sample keeps the label it got when last sampled at the
+// same place while its hue, saturation and value have each moved no more
+// than this since
+const int COHERENCE_DELTA = 2;
+// In place of a cached label where there is none
+const unsigned char COHERENCE_EMPTY = 255;
+
+// With FLAG_COARSE_TO_FINE, a full frame search first looks at every
+// 2^pyramid_levels'th sample and keeps coarse blobs of at least this share of
+// the full resolution minimum size
+const int PYRAMID_LEVELS_DEFAULT = 2;
+const float PYRAMID_MIN_POINTS_SHARE = 0.5;
+
+// Stages of a frame, timed in seconds by FramePipeline
+const int STAGE_ROTATE = 0;
+const int STAGE_HSV = 1;
+const int STAGE_CLASSIFY = 2;
+const int STAGE_BLOBS = 3;
+const int STAGE_ANALYSE = 4;
+const int STAGE_TRACK = 5;
+const int STAGE_COUNT = 6;
+
+extern const char* STAGE_NAMES[STAGE_COUNT];
+extern const char* CLASSIFIER_NAMES[CLASSIFIER_COUNT];
+
+// DEFINITIONS
+
+class Object {
+public:
+	std::string name;
+	int flags;
+	int camera;
+	int analysisType;
+	int maxBlobs;
+	int confidenceType;
+	cv::Scalar annotationColor;
+	int annotationType;
+	int enumType;
+	int classifier;
+	Object(std::string name, int flags, int camera, int analysisType, int maxBlobs, int confidenceType, cv::Scalar annotationColor, int annotationType, int enumType, int classifier):
+	name(name)
+	,flags(flags)
+	,camera(camera)
+	,analysisType(analysisType)
+	,maxBlobs(maxBlobs)
+	,confidenceType(confidenceType)
+	,annotationColor(annotationColor)
+	,annotationType(annotationType)
+	,enumType(enumType)
+	,classifier(classifier)
+	{
+	};
+};
+
+// Pixels sampled every step pixels from the frame offset, as separate planes
+// with one row of cols samples for every sampled image row
+class SampleGrid {
+public:
+	int step;
+	int cols;
+	std::vector<unsigned char> hues, sats, brights;
+};
+
+class BlobAnalysis {
+public:
+		int center_x;
+		int center_y;
+		float rotation;
+		unsigned int width;
+		unsigned int height;
+		unsigned int size;
+		// Length over width
+		float elongation;
+		// Share of the fitted rectangle the blob's samples cover, only
+		// filled in by ANALYSIS_MOMENTS
+		float fill;
+
+		BlobAnalysis() {}
+
+		// Constructor for use with ANALYSIS_RECTANGLE
+		BlobAnalysis(const Blob& blob, cv::RotatedRect rectangle) {
+				center_x = (int) rectangle.center.x;
+				center_y = (int) rectangle.center.y;
+				rotation = rectangle.angle;
+				width = (unsigned int) rectangle.size.width;
+				height = (unsigned int) rectangle.size.height;
+				size = blob.size;
+				fill = 0;
+
+				// Convert rotation from degrees to radians
+				rotation *= M_PI / 180.0;
+
+				// Correct dimensions and rotation so that height is always larger
+				if (height < width) {
+						unsigned int temp = height;
+						height = width;
+						width = temp;
+				} else {
+						rotation -= M_PI / 2.0;
+				}
+				elongation = width ? (float) height / width : 0;
+		}
+
+		// Constructor for use with ANALYSIS_MOMENTS. A solid rectangle of
+		// side L has a variance of L^2/12 along it.
+		BlobAnalysis(const Blob& blob, int step) {
+				double x, y, major, minor, angle;
+				blob.principalAxes(step, x, y, major, minor, angle);
+				center_x = (int) x;
+				center_y = (int) y;
+				rotation = angle;
+				width = (unsigned int) sqrt(12 * minor);
+				height = (unsigned int) sqrt(12 * major);
+				size = blob.size;
+				elongation = sqrt(major / minor);
+				fill = std::min(1.0, blob.size * step * step / (12 * sqrt(major * minor)));
+		}
+};
+
+class BlobTrack
+{
+public:
+	int id;
+	int x;
+	int y;
+	// Movement per frame, averaged over recent sightings
+	int dx;
+	int dy;
+	// Reaches every corner of the blob from its center
+	int radius;
+	int lifetime;
+	int lastSeen;
+	int objType;
+	BlobTrack(int id, int x, int y, int radius, int lastSeen, int objType):
+	id(id)
+	,x(x)
+	,y(y)
+	,dx(0)
+	,dy(0)
+	,radius(radius)
+	,lifetime(0)
+	,lastSeen(lastSeen)
+	,objType(objType)
+	{
+	}
+};
+
+// A blob that has been seen enough frames running to be reported, with the
+// id of its track
+class Detection {
+public:
+	int object;
+	int id;
+	BlobAnalysis analysis;
+	float confidence;
+	Detection(int object, int id, const BlobAnalysis& analysis, float confidence):
+	object(object)
+	,id(id)
+	,analysis(analysis)
+	,confidence(confidence)
+	{
+	}
+};
+
+// The tree or forest each object is classified with, indexed like objects,
+// the lookup tables made from them, each object's HSV bounds, its flags and
+// which of them, as a CLASSIFIER_ value, it is classified with.
+// A whole set is swapped in at once, so classifiers and flags can be changed
+// while the cameras are running and a frame never sees half a change.
+class Classifiers {
+public:
+	std::vector<ForestDLT> trees;
+	std::vector<LutDLT> luts;
+	std::vector<HSVRange> ranges;
+	std::vector<int> flags;
+	std::vector<int> methods;
+};
+
+typedef boost::shared_ptr<const Classifiers> ClassifiersPtr;
+
+// GLOBALS  :/  HA HA AH WELL
+
+extern std::vector<Object> objects;
+extern std::vector<bool> objectTracking;
+extern ThreadPool* pool;
+extern int pyramidLevels;
+
+extern bool pizzaCheck;
+extern Object* pizzaObj;
+
+// FUNCTIONS
+
+void initObjects();
+// Classifiers come from a directory of .tree files, each a tree or a forest,
+// or from a bundle made of them by DLTBundle, and replace the current set
+// once all of them load
+bool loadClassifiers(const std::string& source);
+// Read one object's tree again from wherever the current set came from
+bool reloadClassifier(int index, int flags = 0, int mask = 0);
+// Bounds for CLASSIFIER_RANGE, which carry over when the trees are replaced
+bool setClassifierRange(int index, const HSVRange& range, int flags = 0, int mask = 0);
+// Replace the bits of an object's flags in mask. Frames read flags from the
+// current set, never from objects, which only holds where they start. The two
+// above take the same flags and mask, to change them in the same swap.
+bool setObjectFlags(int index, int flags, int mask);
+// Classify an object with a CLASSIFIER_ value from the next frame
+bool setObjectClassifier(int index, int classifier);
+ClassifiersPtr currentClassifiers();
+float computeConfidence(Object& object, BlobAnalysis& a, int step);
+void annotateImage(cv::Mat& image, Object& object, BlobAnalysis& a, float confidence);
+
+// What an object's samples were last classified as at each offset of the
+// sampling grid, for coherence. Each offset has planes of hue, saturation,
+// value and label laid out like the sample grid, one after another. A label
+// is COHERENCE_EMPTY if the sample hasn't been classified yet.
+class CoherenceCache {
+public:
+	CoherenceCache();
+	// What the labels depend on besides the samples themselves, or -1 when
+	// nothing is cached
+	int key;
+	std::vector<std::vector<unsigned char> > phases;
+	// Which samples of a row changed, and those that did, gathered to be
+	// classified together
+	std::vector<unsigned char> changed;
+	std::vector<int> misses;
+	std::vector<unsigned char> missHues, missSats, missBrights, missLabels;
+	unsigned long hits;
+	unsigned long lookups;
+};
+
+// TRACKING
+
+// Follows the blobs of every object seen by one camera from frame to frame.
+// Each track is predicted forward at constant velocity, and each frame's
+// blobs of a type are matched to that type's tracks nearest pair first,
+// within a gate around the prediction. Unmatched blobs start new tracks.
+class BlobTracker {
+public:
+	BlobTracker();
+	// Match one object type's blobs of this frame. ids gets each blob's
+	// track id, or -1 if its track hasn't been seen FRAME_MARGIN_OF_ERROR
+	// times yet.
+	void update(int frame, int type, const std::vector<BlobAnalysis>& blobs, std::vector<int>& ids);
+	// Drop tracks not seen for more than FRAME_MARGIN_OF_ERROR frames
+	void expire(int frame);
+	const std::vector<BlobTrack>& tracks() const;
+
+private:
+	class Pairing {
+	public:
+		int distance;
+		int track;
+		int blob;
+		bool operator<(const Pairing& other) const {
+			return distance < other.distance;
+		}
+	};
+	int freeId();
+	std::vector<BlobTrack> tracked;
+	std::vector<Pairing> pairings;
+	std::vector<bool> trackMatched;
+	std::vector<bool> blobMatched;
+	int nextId;
+};
+
+// FRAME PIPELINE
+
+// All of the per-frame state for one camera: rotating the frame upright,
+// sampling it into HSV, classifying and finding blobs for each of the
+// camera's objects on the pool, and tracking what was found.
+class FramePipeline {
+public:
+	FramePipeline(int camera);
+	// Turn raw upright into image, which must already be the upright size
+	// (it is usually a view of an outgoing message), and find what is in it
+	void process(const cv::Mat& raw, cv::Mat& image, std::vector<Detection>& detections);
+	// Every active object's thresholds in its full resolution search windows
+	void drawThresholds(cv::Mat& combined) const;
+	// The objects looked for in the last frame
+	const std::vector<int>& activeObjects() const;
+	cv::Size uprightSize(const cv::Mat& raw) const;
+	// How long each stage took on the last frame, summed over objects, and
+	// for one of the active objects on its own
+	const double* stageSeconds() const;
+	const std::vector<double>& objectStageSeconds(int index) const;
+	// Sample every spacing'th pixel rather than every SAMPLE_SIZE'th
+	void setSampleStep(int spacing);
+	int sampleStep() const;
+	// Search around confirmed tracks as if every object had FLAG_ROI_TRACKING
+	void setRoiTracking(bool enabled);
+	bool isRoiTracking() const;
+	// Reuse the labels of samples that have hardly changed since they were
+	// last sampled, and how many of the last frame's samples that was
+	void setCoherent(bool enabled);
+	bool isCoherent() const;
+	unsigned long cacheHits() const;
+	unsigned long cacheLookups() const;
+
+private:
+	void rotate(const cv::Mat& raw);
+	void sampleFrame();
+	cv::Rect fullWindow();
+	cv::Rect searchWindow(int index);
+	void classify(int index, const SampleGrid& grid, const cv::Rect& window);
+	int classifierFor(int index) const;
+	void classifySamples(int index, const unsigned char* hues, const unsigned char* sats,
+			const unsigned char* brights, int count, unsigned char* labels);
+	void classifyCoherent(int index, int start, int count, unsigned char* labels);
+	void coarseSearch(int index, std::vector<cv::Rect>& refine);
+	void detect(int index);
+
+	int camera;
+	int step;
+	bool roiTracking;
+	bool coherent;
+	int offset;
+	cv::Mat rotated;
+	cv::Mat rotateMap;
+	cv::Size rotateSize;
+	// Sampled pixels of the current frame, and every 2^pyramidLevels'th of
+	// those for coarse searches
+	SampleGrid samples;
+	SampleGrid coarseSamples;
+	int avgHue, avgSat, avgBright;
+	std::vector<int> active;
+	std::vector<ThreadPool::Task> tasks;
+	// Indexed like objects
+	std::vector<cv::Rect> windows;
+	std::vector<std::vector<cv::Rect> > refineWindows;
+	std::vector<cv::Mat> thresholds;
+	// A row of labels from classify, per object as objects classify at once
+	std::vector<std::vector<unsigned char> > rowLabels;
+	std::vector<BlobLabeler> labelers;
+	std::vector<std::vector<Blob> > blobs;
+	std::vector<std::vector<BlobAnalysis> > analyses;
+	ClassifiersPtr classifiers;
+	std::vector<LutDLT> luts;
+	std::vector<std::vector<double> > objectSeconds;
+	std::vector<CoherenceCache> caches;
+	unsigned long hits;
+	unsigned long lookups;
+	BlobTracker tracker;
+	// Confident blobs of one object and their track ids
+	std::vector<BlobAnalysis> confident;
+	std::vector<float> confidences;
+	std::vector<int> trackIds;
+	int curFrame;
+	double seconds[STAGE_COUNT];
+};
+
+#endif
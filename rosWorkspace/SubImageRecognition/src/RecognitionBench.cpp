@@ -0,0 +1,279 @@
+#include <dirent.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "Recognition.h"
+
+using namespace cv;
+using namespace std;
+
+// Runs recorded frames through the same pipeline as ImageRecognition, without
+// ROS, and reports how long each stage takes, the frame rate and how many
+// heap allocations each frame makes. Frames are image files, or directories
+// of them taken in name order, as saved from a camera topic.
+//
+//   RecognitionBench [-d] [-c] [-n passes] [-l pyramid levels] [-t threads]
+//           [-r object=hmin,hmax,smin,smax,vmin,vmax]... treedir|bundle frames...
+//
+// -d runs the frames as the downward camera (rotated, looking for paths)
+// rather than the forward one. -c reuses the labels of samples that barely
+// changed since the last frame at the same grid offset, and reports how
+// often it could. -r classifies the object by those HSV bounds instead of
+// its tree, to compare the cost and detections of the two.
+
+const int PASSES_DEFAULT = 5;
+// Frames run before measuring so buffers have grown to size
+const int WARMUP_FRAMES = 10;
+const double PERCENTILES[] = {0.5, 0.9, 0.99};
+const int PERCENTILE_COUNT = 3;
+
+// Every malloc in the process goes through here so the steady state can be
+// checked for allocations, including OpenCV's own buffers
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+}
+
+unsigned long allocations = 0;
+
+extern "C" {
+void* malloc(size_t size) {
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_realloc(pointer, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+	__sync_fetch_and_add(&allocations, 1);
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) {
+	__sync_fetch_and_add(&allocations, 1);
+	*pointer = __libc_memalign(alignment, size);
+	return *pointer ? 0 : ENOMEM;
+}
+
+void free(void* pointer) {
+	__libc_free(pointer);
+}
+}
+
+double now() {
+	timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+bool isDirectory(const string& path) {
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Add the frame at path, or every frame in it if it is a directory
+void loadFrames(const string& path, vector<Mat>& frames) {
+	if (!isDirectory(path)) {
+		Mat frame = imread(path);
+		if (frame.empty()) {
+			fprintf(stderr, "skipping %s: not an image\n", path.c_str());
+		} else {
+			frames.push_back(frame);
+		}
+		return;
+	}
+	vector<string> names;
+	DIR* directory = opendir(path.c_str());
+	if (!directory) {
+		fprintf(stderr, "cannot read %s\n", path.c_str());
+		exit(1);
+	}
+	for (dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+		if (entry->d_name[0] != '.') {
+			names.push_back(path + "/" + entry->d_name);
+		}
+	}
+	closedir(directory);
+	sort(names.begin(), names.end());
+	for (unsigned int i = 0; i < names.size(); i++) {
+		loadFrames(names[i], frames);
+	}
+}
+
+void report(const char* name, vector<double>& samples) {
+	sort(samples.begin(), samples.end());
+	printf("  %-10s", name);
+	for (int i = 0; i < PERCENTILE_COUNT; i++) {
+		unsigned int index = min(samples.size() - 1, (size_t) (PERCENTILES[i] * samples.size()));
+		printf(" %8.3f", samples[index] * 1000);
+	}
+	printf(" %8.3f\n", samples.back() * 1000);
+}
+
+void usage(const char* program) {
+	fprintf(stderr, "usage: %s [-d] [-c] [-n passes] [-l pyramid levels] [-t threads]"
+			" [-r object=hmin,hmax,smin,smax,vmin,vmax]... treedir|bundle frames...\n", program);
+}
+
+// Switch the object named in an -r argument to CLASSIFIER_RANGE
+bool classifyByRange(const string& argument) {
+	size_t equals = argument.find('=');
+	int bounds[6];
+	if (equals == string::npos || sscanf(argument.c_str() + equals + 1, "%d,%d,%d,%d,%d,%d",
+			&bounds[0], &bounds[1], &bounds[2], &bounds[3], &bounds[4], &bounds[5]) != 6) {
+		return false;
+	}
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		if (objects[i].name == argument.substr(0, equals)) {
+			return setClassifierRange(i, HSVRange(bounds[0], bounds[1], bounds[2],
+					bounds[3], bounds[4], bounds[5])) && setObjectClassifier(i, CLASSIFIER_RANGE);
+		}
+	}
+	return false;
+}
+
+int main(int argc, char **argv) {
+	int camera = CAMERA_FORWARD;
+	int passes = PASSES_DEFAULT;
+	// hardware_concurrency is 0 when it can't tell
+	unsigned int cores = boost::thread::hardware_concurrency();
+	int threads = cores > 1 ? cores - 1 : 1;
+	bool coherent = false;
+	vector<string> ranges;
+	int option;
+	while ((option = getopt(argc, argv, "dcn:l:t:r:")) != -1) {
+		switch (option) {
+		case 'd':
+			camera = CAMERA_DOWNWARD;
+			break;
+		case 'c':
+			coherent = true;
+			break;
+		case 'n':
+			passes = max(1, atoi(optarg));
+			break;
+		case 'l':
+			pyramidLevels = max(0, atoi(optarg));
+			break;
+		case 't':
+			threads = max(1, atoi(optarg));
+			break;
+		case 'r':
+			ranges.push_back(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	initObjects();
+	if (!loadClassifiers(argv[optind])) {
+		fprintf(stderr, "cannot load the classifiers from %s\n", argv[optind]);
+		return 1;
+	}
+	for (unsigned int i = 0; i < ranges.size(); i++) {
+		if (!classifyByRange(ranges[i])) {
+			fprintf(stderr, "bad range %s\n", ranges[i].c_str());
+			return 1;
+		}
+	}
+	vector<Mat> frames;
+	for (int i = optind + 1; i < argc; i++) {
+		loadFrames(argv[i], frames);
+	}
+	if (frames.empty()) {
+		fprintf(stderr, "no frames\n");
+		return 1;
+	}
+
+	pool = new ThreadPool(threads);
+	FramePipeline pipeline(camera);
+	pipeline.setCoherent(coherent);
+	vector<Detection> detections;
+	Size upright = pipeline.uprightSize(frames[0]);
+	Mat image(upright.height, upright.width, CV_8UC3);
+
+	for (int i = 0; i < WARMUP_FRAMES; i++) {
+		pipeline.process(frames[i % frames.size()], image, detections);
+	}
+
+	// Sized up front so the bench's own bookkeeping isn't counted per frame
+	vector<vector<double> > stages(STAGE_COUNT);
+	vector<double> totals;
+	totals.reserve(passes * frames.size());
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		stages[stage].reserve(passes * frames.size());
+	}
+	unsigned long found = 0;
+	unsigned long hits = 0, lookups = 0;
+	vector<unsigned long> objectFound(objects.size());
+	unsigned long allocated = allocations;
+	double start = now();
+	for (int pass = 0; pass < passes; pass++) {
+		for (unsigned int i = 0; i < frames.size(); i++) {
+			double frameStart = now();
+			pipeline.process(frames[i], image, detections);
+			totals.push_back(now() - frameStart);
+			for (int stage = 0; stage < STAGE_COUNT; stage++) {
+				stages[stage].push_back(pipeline.stageSeconds()[stage]);
+			}
+			found += detections.size();
+			hits += pipeline.cacheHits();
+			lookups += pipeline.cacheLookups();
+			for (unsigned int d = 0; d < detections.size(); d++) {
+				objectFound[detections[d].object]++;
+			}
+		}
+	}
+	double elapsed = now() - start;
+	allocated = allocations - allocated;
+
+	printf("%u frames x %d passes, %d pool threads, pyramid levels %d\n",
+			(unsigned int) frames.size(), passes, threads, pyramidLevels);
+	printf("  %-10s %8s %8s %8s %8s  (ms)\n", "stage", "p50", "p90", "p99", "max");
+	for (int stage = 0; stage < STAGE_COUNT; stage++) {
+		report(STAGE_NAMES[stage], stages[stage]);
+	}
+	report("frame", totals);
+	printf("  %.1f frames/s, %.1f allocations/frame, %.2f detections/frame\n",
+			totals.size() / elapsed, (double) allocated / totals.size(),
+			(double) found / totals.size());
+	if (coherent) {
+		printf("  %.1f%% of %.0f samples/frame kept their labels\n",
+				lookups ? 100.0 * hits / lookups : 0, (double) lookups / totals.size());
+	}
+	ClassifiersPtr classifiers = currentClassifiers();
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		if (objectFound[i]) {
+			printf("  %-10s %.2f detections/frame by %s\n", objects[i].name.c_str(),
+					(double) objectFound[i] / totals.size(), CLASSIFIER_NAMES[classifiers->methods[i]]);
+		}
+	}
+	delete pool;
+	return 0;
+}
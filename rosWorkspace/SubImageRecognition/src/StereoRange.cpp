@@ -0,0 +1,103 @@
+#include "StereoRange.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <limits.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STEREO_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define STEREO_NEON
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+// Every ROW_STEP'th row of the box is matched
+const int ROW_STEP = 2;
+// Boxes narrower than this have too little to match on
+const int MIN_WIDTH = 8;
+// The best shift must beat any other, bar its neighbours, by this share of
+// its cost, or it is ambiguous
+const double UNIQUENESS = 0.15;
+
+// Sum of absolute differences of count bytes
+unsigned int differences(const uchar* a, const uchar* b, int count) {
+	unsigned int sum = 0;
+	int i = 0;
+#if defined(STEREO_SSE2)
+	__m128i total = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		total = _mm_add_epi64(total, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (a + i)),
+				_mm_loadu_si128((const __m128i*) (b + i))));
+	}
+	sum = _mm_cvtsi128_si32(total) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(total, total));
+#elif defined(STEREO_NEON)
+	uint32x4_t total = vdupq_n_u32(0);
+	for (; i + 16 <= count; i += 16) {
+		total = vpadalq_u16(total, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+	}
+	uint32x2_t half = vadd_u32(vget_low_u32(total), vget_high_u32(total));
+	sum = vget_lane_u32(vpadd_u32(half, half), 0);
+#endif
+	for (; i < count; i++) {
+		sum += abs(a[i] - b[i]);
+	}
+	return sum;
+}
+
+}
+
+StereoRange::StereoRange(double focalLength, double baseline, int maxDisparity):
+focalLength(focalLength)
+,baseline(baseline)
+,maxDisparity(maxDisparity)
+{
+}
+
+bool StereoRange::isEnabled() const {
+	return baseline > 0 && focalLength > 0 && maxDisparity > 0;
+}
+
+float StereoRange::range(const Mat& right, const Mat& left, const Rect& box) {
+	Rect clipped = box & Rect(0, 0, right.cols, right.rows);
+	// Something at x in the right image is at x + disparity in the left
+	int shifts = min(maxDisparity, left.cols - clipped.x - clipped.width);
+	if (clipped.width < MIN_WIDTH || clipped.height <= 0 || shifts < 2) {
+		return 0;
+	}
+	costs.assign(shifts + 1, 0);
+	int bytes = clipped.width * 3;
+	for (int y = clipped.y; y < clipped.y + clipped.height; y += ROW_STEP) {
+		const uchar* from = right.ptr<uchar>(y) + clipped.x * 3;
+		const uchar* to = left.ptr<uchar>(y) + clipped.x * 3;
+		for (int d = 0; d <= shifts; d++) {
+			costs[d] += differences(from, to + d * 3, bytes);
+		}
+	}
+
+	int best = min_element(costs.begin(), costs.end()) - costs.begin();
+	// At either end the true minimum may lie beyond what was searched, and
+	// no shift at all is out of range
+	if (best == 0 || best == shifts) {
+		return 0;
+	}
+	unsigned int rival = UINT_MAX;
+	for (int d = 0; d <= shifts; d++) {
+		if (abs(d - best) > 1) {
+			rival = min(rival, costs[d]);
+		}
+	}
+	if (rival != UINT_MAX && rival < costs[best] * (1 + UNIQUENESS)) {
+		return 0;
+	}
+	// Fit a parabola through the best shift and its neighbours for a
+	// fraction of a pixel more
+	double before = costs[best - 1], at = costs[best], after = costs[best + 1];
+	double curve = before - 2 * at + after;
+	double disparity = best + (curve > 0 ? (before - after) / (2 * curve) : 0);
+	return focalLength * baseline / disparity;
+}
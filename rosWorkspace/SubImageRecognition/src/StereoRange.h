@@ -0,0 +1,28 @@
+#ifndef _STEREO_RANGE_H
+#define _STEREO_RANGE_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+// Range to something found in the right image of a rectified stereo pair,
+// from how far its box has to shift right to line up with the left image.
+// Only the box itself is matched, so it costs a small fraction of a full
+// disparity map.
+class StereoRange {
+public:
+	// focalLength in pixels, baseline in metres. A baseline of 0 leaves it
+	// disabled.
+	StereoRange(double focalLength, double baseline, int maxDisparity);
+	bool isEnabled() const;
+	// Metres to whatever fills box in right, or 0 if the box can't be
+	// matched unambiguously. Both images must be the same size of CV_8UC3.
+	float range(const cv::Mat& right, const cv::Mat& left, const cv::Rect& box);
+
+private:
+	double focalLength;
+	double baseline;
+	int maxDisparity;
+	std::vector<unsigned int> costs;
+};
+
+#endif
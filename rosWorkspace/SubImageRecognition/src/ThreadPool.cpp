@@ -0,0 +1,67 @@
+#include "ThreadPool.h"
+#include <boost/bind.hpp>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int threads):
+stopping(false)
+{
+	for (unsigned int i = 0; i < threads; i++) {
+		this->threads.create_thread(boost::bind(&ThreadPool::work, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		stopping = true;
+	}
+	queued.notify_all();
+	threads.join_all();
+}
+
+void ThreadPool::run(const vector<Task>& tasks) {
+	if (tasks.empty()) {
+		return;
+	}
+	Batch batch;
+	batch.remaining = tasks.size();
+	boost::unique_lock<boost::mutex> lock(mutex);
+	for (unsigned int i = 0; i < tasks.size(); i++) {
+		Job job;
+		job.task = tasks[i];
+		job.batch = &batch;
+		jobs.push_back(job);
+	}
+	queued.notify_all();
+	while (batch.remaining > 0) {
+		if (!runOne(lock)) {
+			finished.wait(lock);
+		}
+	}
+}
+
+void ThreadPool::work() {
+	boost::unique_lock<boost::mutex> lock(mutex);
+	while (!stopping) {
+		if (!runOne(lock)) {
+			queued.wait(lock);
+		}
+	}
+}
+
+// Runs the oldest queued task with the lock released; false if none queued
+bool ThreadPool::runOne(boost::unique_lock<boost::mutex>& lock) {
+	if (jobs.empty()) {
+		return false;
+	}
+	Job job = jobs.front();
+	jobs.pop_front();
+	lock.unlock();
+	job.task();
+	lock.lock();
+	if (--job.batch->remaining == 0) {
+		finished.notify_all();
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+// Fixed set of worker threads shared by every camera. run() hands over a
+// batch of independent tasks and returns once all of them have finished;
+// the calling thread works through queued tasks while it waits, so several
+// cameras can fan out into the same pool at once.
+class ThreadPool {
+public:
+	typedef boost::function<void()> Task;
+
+	ThreadPool(unsigned int threads);
+	~ThreadPool();
+	void run(const std::vector<Task>& tasks);
+
+private:
+	struct Batch {
+		unsigned int remaining;
+	};
+	struct Job {
+		Task task;
+		Batch* batch;
+	};
+
+	void work();
+	bool runOne(boost::unique_lock<boost::mutex>& lock);
+
+	boost::mutex mutex;
+	boost::condition_variable queued;
+	boost::condition_variable finished;
+	std::deque<Job> jobs;
+	bool stopping;
+	boost::thread_group threads;
+};
+
+#endif